@@ -0,0 +1,284 @@
+/* audio.c - 48 kHz audio callback allocating FFT frames per block
+ *
+ * Simulates a host calling a plugin every 128 frames (2.67 ms). Each callback
+ * allocates one FFT frame per channel plus a window table, runs a 1024-point
+ * FFT and overlap-add on them and frees everything before returning. Between
+ * callbacks the rest of the process (GUI, file I/O) churns malloc() with
+ * sizes from 16 bytes to 512 KiB, untimed, as it would on a real host.
+ *
+ * The callback is run once with its frames from detalloc and once from
+ * malloc(); everything else is identical, including the random seed.
+ * Reported per engine: percentiles of the time spent in the allocator per
+ * callback (allocs plus frees) and of the whole callback, and callbacks that
+ * overran the budget (default 10% of the period, the share a plugin
+ * typically gets).
+ *
+ * Usage: bench_audio [callbacks] [budget_us]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <detalloc.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RATE 48000
+#define FRAMES 128
+#define CHANNELS 2
+#define FFT_SIZE 1024
+#define HOUSEKEEPING_LIVE 64
+
+typedef struct {
+  float re;
+  float im;
+} cpx_t;
+
+typedef struct {
+  const char *name;
+  void *(*alloc)(size_t size);
+  void (*release)(void *ptr);
+} engine_t;
+
+static det_allocator_t *det;
+static void *housekeeping[HOUSEKEEPING_LIVE];
+static float output[CHANNELS][FRAMES];
+static uint64_t rng;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void *det_engine_alloc(size_t size) {
+  return det_alloc_sized(det, size);
+}
+
+static void det_engine_free(void *ptr) { det_free(det, ptr); }
+
+static void *libc_alloc(size_t size) { return malloc(size); }
+
+static void libc_free(void *ptr) { free(ptr); }
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* In-place iterative radix-2 FFT. */
+static void fft(cpx_t *x, size_t n) {
+  size_t i;
+  size_t j = 0;
+  size_t len;
+
+  for (i = 1; i < n; i++) {
+    size_t bit = n >> 1;
+
+    for (; (j & bit) != 0; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      cpx_t t = x[i];
+
+      x[i] = x[j];
+      x[j] = t;
+    }
+  }
+  for (len = 2; len <= n; len <<= 1) {
+    float ang = -6.28318530718f / (float)len;
+    cpx_t wl = {cosf(ang), sinf(ang)};
+
+    for (i = 0; i < n; i += len) {
+      cpx_t w = {1.0f, 0.0f};
+
+      for (j = 0; j < len / 2; j++) {
+        cpx_t u = x[i + j];
+        cpx_t v = x[i + j + len / 2];
+        cpx_t t = {v.re * w.re - v.im * w.im, v.re * w.im + v.im * w.re};
+        float wr = w.re * wl.re - w.im * wl.im;
+
+        x[i + j].re = u.re + t.re;
+        x[i + j].im = u.im + t.im;
+        x[i + j + len / 2].re = u.re - t.re;
+        x[i + j + len / 2].im = u.im - t.im;
+        w.im = w.re * wl.im + w.im * wl.re;
+        w.re = wr;
+      }
+    }
+  }
+}
+
+/* The rest of the process: untimed malloc() churn between callbacks. */
+static void housekeep(void) {
+  unsigned k;
+
+  for (k = 0; k < 4; k++) {
+    size_t slot = (size_t)(next_rand() % HOUSEKEEPING_LIVE);
+    size_t size = (size_t)16 << (next_rand() % 16); /* 16 B .. 512 KiB */
+
+    free(housekeeping[slot]);
+    housekeeping[slot] = malloc(size);
+    if (housekeeping[slot] != NULL) {
+      memset(housekeeping[slot], 0, size < 4096 ? size : 4096);
+    }
+  }
+}
+
+static void *timed_alloc(const engine_t *e, size_t size, uint64_t *spent) {
+  uint64_t t0 = now_ns();
+  void *ptr = e->alloc(size);
+
+  *spent += now_ns() - t0;
+  return ptr;
+}
+
+static void timed_free(const engine_t *e, void *ptr, uint64_t *spent) {
+  uint64_t t0 = now_ns();
+
+  e->release(ptr);
+  *spent += now_ns() - t0;
+}
+
+/* One audio callback; returns its duration, or 0 if an allocation failed.
+ * *spent receives the time spent in the allocator. */
+static uint64_t callback(const engine_t *e, unsigned n, uint64_t *spent) {
+  cpx_t *frame[CHANNELS];
+  float *window;
+  uint64_t t0 = now_ns();
+  size_t c;
+  size_t i;
+
+  *spent = 0;
+  window = timed_alloc(e, FFT_SIZE * sizeof(float), spent);
+  if (window == NULL) {
+    return 0;
+  }
+  for (c = 0; c < CHANNELS; c++) {
+    frame[c] = timed_alloc(e, FFT_SIZE * sizeof(cpx_t), spent);
+    if (frame[c] == NULL) {
+      return 0;
+    }
+  }
+  for (i = 0; i < FFT_SIZE; i++) {
+    window[i] = 0.5f - 0.5f * cosf(6.28318530718f * (float)i / FFT_SIZE);
+  }
+  for (c = 0; c < CHANNELS; c++) {
+    for (i = 0; i < FFT_SIZE; i++) {
+      float s = sinf((float)(n * FRAMES + i) * 0.05f * (float)(c + 1));
+
+      frame[c][i].re = s * window[i];
+      frame[c][i].im = 0.0f;
+    }
+    fft(frame[c], FFT_SIZE);
+    for (i = 0; i < FRAMES; i++) {
+      output[c][i] = frame[c][i].re * (1.0f / FFT_SIZE);
+    }
+  }
+  for (c = 0; c < CHANNELS; c++) {
+    timed_free(e, frame[c], spent);
+  }
+  timed_free(e, window, spent);
+  return now_ns() - t0;
+}
+
+static void print_row(const char *name, const char *what, uint64_t *t,
+                      size_t n, unsigned misses) {
+  qsort(t, n, sizeof(*t), cmp_u64);
+  printf("%-9s %-9s %9llu %9llu %9llu %9llu %8u\n", name, what,
+         (unsigned long long)t[n / 2], (unsigned long long)t[n * 99 / 100],
+         (unsigned long long)t[n * 999 / 1000], (unsigned long long)t[n - 1],
+         misses);
+}
+
+static int run(const engine_t *e, unsigned callbacks, uint64_t budget) {
+  uint64_t *t = malloc(callbacks * sizeof(*t));
+  uint64_t *a = malloc(callbacks * sizeof(*a));
+  unsigned misses = 0;
+  unsigned n;
+
+  if (t == NULL || a == NULL) {
+    free(t);
+    free(a);
+    return 1;
+  }
+  rng = 0x9E3779B97F4A7C15u;
+  memset(housekeeping, 0, sizeof(housekeeping));
+  for (n = 0; n < callbacks; n++) {
+    housekeep();
+    t[n] = callback(e, n, &a[n]);
+    if (t[n] == 0) {
+      printf("%-9s allocation failed\n", e->name);
+      free(t);
+      free(a);
+      return 1;
+    }
+    misses += t[n] > budget;
+  }
+  for (n = 0; n < HOUSEKEEPING_LIVE; n++) {
+    free(housekeeping[n]);
+  }
+  print_row(e->name, "allocator", a, callbacks, 0);
+  print_row("", "callback", t, callbacks, misses);
+  free(t);
+  free(a);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  static const det_class_config_t classes[] = {
+      {FFT_SIZE * sizeof(float), 4, DET_LIFETIME_ANY, 0},
+      {FFT_SIZE * sizeof(cpx_t), 2 * CHANNELS, DET_LIFETIME_ANY, 0}};
+  const engine_t engines[] = {{"detalloc", det_engine_alloc, det_engine_free},
+                              {"malloc", libc_alloc, libc_free}};
+  unsigned callbacks = argc > 1 ? (unsigned)atoi(argv[1]) : 20000;
+  uint64_t period = (uint64_t)FRAMES * 1000000000u / RATE;
+  uint64_t budget = argc > 2 ? (uint64_t)atoi(argv[2]) * 1000u : period / 10;
+  det_config_t cfg = det_default_config();
+  void *arena;
+  size_t size;
+  int failed = 0;
+
+  if (callbacks == 0) {
+    callbacks = 20000;
+  }
+  cfg.classes = classes;
+  cfg.num_classes = 2;
+  size = det_alloc_size(&cfg);
+  arena = malloc(size);
+  if (arena == NULL) {
+    return 1;
+  }
+  memset(arena, 0, size); /* prefault, as an RT host would at startup */
+  det = det_alloc_init(arena, size, &cfg);
+  if (det == NULL) {
+    printf("det_alloc_init failed\n");
+    return 1;
+  }
+
+  printf("=== Audio callback: %d Hz, %d frames (%.2f ms), %d x %d-point "
+         "FFT, budget %llu us, %u callbacks ===\n\n",
+         RATE, FRAMES, (double)period / 1e6, CHANNELS, FFT_SIZE,
+         (unsigned long long)(budget / 1000u), callbacks);
+  printf("%-9s %-9s %9s %9s %9s %9s %8s\n", "engine", "time", "p50 ns",
+         "p99 ns", "p99.9 ns", "max ns", "misses");
+  failed |= run(&engines[0], callbacks, budget);
+  failed |= run(&engines[1], callbacks, budget);
+
+  det_alloc_destroy(det);
+  free(arena);
+  return failed;
+}
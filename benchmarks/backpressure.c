@@ -0,0 +1,240 @@
+/* backpressure.c - producer throttled by a full pool: spin-retry vs wait
+ *
+ * A producer thread allocates a 256-byte message per item, fills it and
+ * hands it to a consumer over a single-producer/single-consumer ring; the
+ * consumer spends about 2 us per item and frees it. The consumer is the
+ * slow stage, so the 64-block pool stays full and the producer spends most
+ * of its time waiting for blocks: by retrying det_alloc() with
+ * sched_yield() in between, or by sleeping in det_alloc_wait() (woken by
+ * every free).
+ *
+ * Reported per mode, on thread_safe and signal_safe pools: wall time, items
+ * per second, the producer's CPU time (what spinning steals from the
+ * consumer and everything else on the machine) and its failed det_alloc()
+ * calls. Also checks that every item arrives intact and that
+ * det_alloc_wait() on a full pool with nobody freeing returns NULL after
+ * its timeout, and prints PASS or FAIL.
+ *
+ * Usage: bench_backpressure [items]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <detalloc.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK 256
+#define BLOCKS 64
+#define RING 128 /* power of two, > BLOCKS so the ring never fills */
+#define WORK_NS 2000u
+
+typedef struct {
+  uint64_t seq;
+  uint64_t sum;
+} msg_t;
+
+typedef struct {
+  void *slot[RING];
+  size_t head; /* written by the consumer */
+  char pad[64];
+  size_t tail; /* written by the producer */
+} ring_t;
+
+static det_allocator_t *det;
+static ring_t ring;
+static unsigned items;
+static int use_wait;
+static uint64_t retries;
+static uint64_t producer_cpu;
+static uint64_t consumed;
+static int corrupt;
+
+static uint64_t clock_ns(clockid_t clk) {
+  struct timespec ts;
+
+  clock_gettime(clk, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void ring_push(void *p) {
+  size_t tail = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+
+  ring.slot[tail % RING] = p;
+  __atomic_store_n(&ring.tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void *ring_pop(void) {
+  size_t head = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+  void *p;
+
+  if (head == __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  p = ring.slot[head % RING];
+  __atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+  return p;
+}
+
+static void *producer_main(void *arg) {
+  uint64_t t0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+  unsigned i;
+
+  (void)arg;
+  for (i = 0; i < items; i++) {
+    msg_t *m;
+
+    if (use_wait) {
+      while ((m = det_alloc_wait(det, UINT64_MAX)) == NULL) {
+        retries++;
+      }
+    } else {
+      while ((m = det_alloc(det)) == NULL) {
+        retries++;
+        sched_yield();
+      }
+    }
+    m->seq = i;
+    m->sum = (uint64_t)i * 0x9E3779B97F4A7C15u;
+    memset(m + 1, (int)(i & 0xFF), BLOCK - sizeof(*m));
+    ring_push(m);
+  }
+  producer_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+  return NULL;
+}
+
+static void *consumer_main(void *arg) {
+  uint64_t expect = 0;
+
+  (void)arg;
+  while (expect < items) {
+    const msg_t *m = ring_pop();
+    uint64_t t0;
+
+    if (m == NULL) {
+      sched_yield();
+      continue;
+    }
+    if (m->seq != expect || m->sum != expect * 0x9E3779B97F4A7C15u ||
+        ((const unsigned char *)(m + 1))[0] != (unsigned char)(expect & 0xFF)) {
+      corrupt = 1;
+    }
+    t0 = clock_ns(CLOCK_MONOTONIC);
+    while (clock_ns(CLOCK_MONOTONIC) - t0 < WORK_NS) {
+    }
+    det_free(det, (void *)m);
+    expect++;
+  }
+  consumed = expect;
+  return NULL;
+}
+
+/* One pipeline run; returns 0 on success. */
+static int run(void *mem, size_t size, int signal_safe, int wait) {
+  det_config_t cfg = det_default_config();
+  pthread_t prod;
+  pthread_t cons;
+  uint64_t t0;
+  uint64_t wall;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.thread_safe = !signal_safe;
+  cfg.signal_safe = signal_safe;
+  det = det_alloc_init(mem, size, &cfg);
+  if (det == NULL) {
+    return 1;
+  }
+  memset(&ring, 0, sizeof(ring));
+  use_wait = wait;
+  retries = 0;
+  consumed = 0;
+  corrupt = 0;
+
+  t0 = clock_ns(CLOCK_MONOTONIC);
+  if (pthread_create(&cons, NULL, consumer_main, NULL) != 0 ||
+      pthread_create(&prod, NULL, producer_main, NULL) != 0) {
+    return 1;
+  }
+  pthread_join(prod, NULL);
+  pthread_join(cons, NULL);
+  wall = clock_ns(CLOCK_MONOTONIC) - t0;
+
+  printf("%-12s %-14s %9.1f %12.0f %12.1f %10llu\n",
+         signal_safe ? "signal_safe" : "thread_safe",
+         wait ? "wait" : "spin+yield",
+         (double)wall / 1e6, (double)items * 1e9 / (double)wall,
+         (double)producer_cpu / 1e6, (unsigned long long)retries);
+  det_alloc_destroy(det);
+  return consumed != items || corrupt;
+}
+
+/* A full pool with nobody freeing: the wait must time out, not hang. */
+static int check_timeout(void *mem, size_t size) {
+  det_config_t cfg = det_default_config();
+  uint64_t t0;
+  uint64_t waited;
+  unsigned i;
+  int failed = 0;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.thread_safe = true;
+  det = det_alloc_init(mem, size, &cfg);
+  if (det == NULL) {
+    return 1;
+  }
+  for (i = 0; i < BLOCKS; i++) {
+    failed |= det_alloc(det) == NULL;
+  }
+  t0 = clock_ns(CLOCK_MONOTONIC);
+  failed |= det_alloc_wait(det, 2000000u) != NULL;
+  waited = clock_ns(CLOCK_MONOTONIC) - t0;
+  failed |= waited < 2000000u;
+  printf("\nFull pool, 2 ms timeout: returned NULL after %.2f ms\n",
+         (double)waited / 1e6);
+  det_alloc_destroy(det);
+  return failed;
+}
+
+int main(int argc, char **argv) {
+  det_config_t cfg = det_default_config();
+  size_t size;
+  void *mem;
+  int mode;
+  int failed = 0;
+
+  items = argc > 1 ? (unsigned)atoi(argv[1]) : 50000;
+  if (items == 0) {
+    items = 50000;
+  }
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.signal_safe = true; /* the larger of the two layouts */
+  size = det_alloc_size(&cfg);
+  mem = malloc(size);
+  if (mem == NULL) {
+    return 1;
+  }
+
+  printf("=== Backpressure: %d x %d-byte pool, consumer %u ns/item, %u "
+         "items ===\n\n",
+         BLOCKS, BLOCK, WORK_NS, items);
+  printf("%-12s %-14s %9s %12s %12s %10s\n", "pool", "producer", "wall ms",
+         "items/s", "prod cpu ms", "retries");
+  for (mode = 0; mode < 4; mode++) {
+    if (run(mem, size, mode >= 2, mode % 2 != 0) != 0) {
+      printf("run failed\n");
+      failed = 1;
+    }
+  }
+  failed |= check_timeout(mem, size);
+
+  free(mem);
+  printf("\n%s\n", failed ? "FAIL" : "PASS");
+  return failed;
+}
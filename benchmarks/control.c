@@ -0,0 +1,261 @@
+/* control.c - 1 kHz control loop with message churn
+ *
+ * Every cycle the loop receives 8 to 24 sensor messages of 24 to 512 bytes,
+ * each kept for 1 to 64 cycles (a timing wheel frees it when it expires),
+ * runs a small state-feedback update over the latest readings and emits 4
+ * actuator commands that live until the next cycle. Between cycles a
+ * telemetry/logging task churns malloc() with log lines and the occasional
+ * large buffer, untimed, as the non-RT part of a controller would.
+ *
+ * The loop runs once with its messages in detalloc size classes and once in
+ * malloc(); everything else is identical, including the random seed.
+ * Reported per engine: percentiles of the allocator time per cycle and of
+ * the whole cycle, and cycles that overran the budget (default 50 us, 5% of
+ * the 1 ms period).
+ *
+ * Usage: bench_control [cycles] [budget_us]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <detalloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WHEEL 64      /* longest message lifetime in cycles */
+#define MAX_RX 24     /* sensor messages per cycle, at most */
+#define COMMANDS 4    /* actuator commands per cycle */
+#define STATES 8      /* controller state vector */
+#define LOG_LIVE 32   /* telemetry buffers kept by the non-RT task */
+#define CLASS_BLOCKS (WHEEL * MAX_RX + 2 * COMMANDS)
+
+typedef struct {
+  const char *name;
+  void *(*alloc)(size_t size);
+  void (*release)(void *ptr);
+} engine_t;
+
+typedef struct msg {
+  struct msg *next; /* timing wheel chain */
+  uint32_t sensor;
+  uint32_t len;
+  double value;
+} msg_t;
+
+static det_allocator_t *det;
+static msg_t *wheel[WHEEL];
+static void *commands[COMMANDS];
+static void *logs[LOG_LIVE];
+static double state[STATES];
+static uint64_t rng;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void *det_engine_alloc(size_t size) {
+  return det_alloc_sized(det, size);
+}
+
+static void det_engine_free(void *ptr) { det_free(det, ptr); }
+
+static void *libc_alloc(size_t size) { return malloc(size); }
+
+static void libc_free(void *ptr) { free(ptr); }
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* The non-RT side: untimed log lines and telemetry buffers. */
+static void telemetry(void) {
+  size_t slot = (size_t)(next_rand() % LOG_LIVE);
+  size_t size = next_rand() % 16 == 0 ? (size_t)65536 << (next_rand() % 3)
+                                      : 32 + (size_t)(next_rand() % 480);
+
+  free(logs[slot]);
+  logs[slot] = malloc(size);
+  if (logs[slot] != NULL) {
+    memset(logs[slot], '#', size < 1024 ? size : 1024);
+  }
+}
+
+/* One control cycle; returns its duration, or 0 if an allocation failed.
+ * *spent receives the time spent in the allocator. */
+static uint64_t cycle(const engine_t *e, unsigned n, uint64_t *spent) {
+  unsigned rx = 8 + (unsigned)(next_rand() % (MAX_RX - 8 + 1));
+  uint64_t t0 = now_ns();
+  uint64_t ta;
+  msg_t *m;
+  unsigned i;
+
+  *spent = 0;
+  /* Expire this slot's messages and last cycle's commands. */
+  ta = now_ns();
+  for (m = wheel[n % WHEEL]; m != NULL;) {
+    msg_t *next = m->next;
+
+    e->release(m);
+    m = next;
+  }
+  wheel[n % WHEEL] = NULL;
+  for (i = 0; i < COMMANDS; i++) {
+    e->release(commands[i]);
+    commands[i] = NULL;
+  }
+  *spent += now_ns() - ta;
+
+  for (i = 0; i < rx; i++) {
+    uint32_t len = (uint32_t)24 << (next_rand() % 5); /* 24 .. 384 */
+    unsigned life = 1 + (unsigned)(next_rand() % WHEEL);
+
+    len += (uint32_t)(next_rand() % 128);
+    ta = now_ns();
+    m = e->alloc(len);
+    *spent += now_ns() - ta;
+    if (m == NULL) {
+      return 0;
+    }
+    m->sensor = (uint32_t)(next_rand() % STATES);
+    m->len = len;
+    m->value = (double)(next_rand() % 1000) / 1000.0;
+    memset(m + 1, 0, len - sizeof(*m));
+    m->next = wheel[(n + life) % WHEEL];
+    wheel[(n + life) % WHEEL] = m;
+    /* Feedback: x += K (y - x) on the reading's state. */
+    state[m->sensor] += 0.1 * (m->value - state[m->sensor]);
+  }
+
+  for (i = 0; i < COMMANDS; i++) {
+    double *cmd;
+
+    ta = now_ns();
+    cmd = e->alloc(STATES * sizeof(double));
+    *spent += now_ns() - ta;
+    if (cmd == NULL) {
+      return 0;
+    }
+    memcpy(cmd, state, sizeof(state));
+    commands[i] = cmd;
+  }
+  return now_ns() - t0;
+}
+
+static void print_row(const char *name, const char *what, uint64_t *t,
+                      size_t n, unsigned misses) {
+  qsort(t, n, sizeof(*t), cmp_u64);
+  printf("%-9s %-9s %9llu %9llu %9llu %9llu %8u\n", name, what,
+         (unsigned long long)t[n / 2], (unsigned long long)t[n * 99 / 100],
+         (unsigned long long)t[n * 999 / 1000], (unsigned long long)t[n - 1],
+         misses);
+}
+
+static int run(const engine_t *e, unsigned cycles, uint64_t budget) {
+  uint64_t *t = malloc(cycles * sizeof(*t));
+  uint64_t *a = malloc(cycles * sizeof(*a));
+  unsigned misses = 0;
+  unsigned n;
+  int failed = 0;
+
+  if (t == NULL || a == NULL) {
+    free(t);
+    free(a);
+    return 1;
+  }
+  rng = 0x9E3779B97F4A7C15u;
+  memset(wheel, 0, sizeof(wheel));
+  memset(commands, 0, sizeof(commands));
+  memset(logs, 0, sizeof(logs));
+  memset(state, 0, sizeof(state));
+  for (n = 0; n < cycles; n++) {
+    telemetry();
+    t[n] = cycle(e, n, &a[n]);
+    if (t[n] == 0) {
+      printf("%-9s allocation failed\n", e->name);
+      failed = 1;
+      break;
+    }
+    misses += t[n] > budget;
+  }
+  for (n = 0; n < WHEEL; n++) {
+    while (wheel[n] != NULL) {
+      msg_t *next = wheel[n]->next;
+
+      e->release(wheel[n]);
+      wheel[n] = next;
+    }
+  }
+  for (n = 0; n < COMMANDS; n++) {
+    e->release(commands[n]);
+  }
+  for (n = 0; n < LOG_LIVE; n++) {
+    free(logs[n]);
+  }
+  if (!failed) {
+    print_row(e->name, "allocator", a, cycles, 0);
+    print_row("", "cycle", t, cycles, misses);
+  }
+  free(t);
+  free(a);
+  return failed;
+}
+
+int main(int argc, char **argv) {
+  static const det_class_config_t classes[] = {
+      {64, CLASS_BLOCKS, DET_LIFETIME_ANY, 0},
+      {128, CLASS_BLOCKS, DET_LIFETIME_ANY, 0},
+      {256, CLASS_BLOCKS, DET_LIFETIME_ANY, 0},
+      {512, CLASS_BLOCKS, DET_LIFETIME_ANY, 0}};
+  const engine_t engines[] = {{"detalloc", det_engine_alloc, det_engine_free},
+                              {"malloc", libc_alloc, libc_free}};
+  unsigned cycles = argc > 1 ? (unsigned)atoi(argv[1]) : 50000;
+  uint64_t budget = argc > 2 ? (uint64_t)atoi(argv[2]) * 1000u : 50000u;
+  det_config_t cfg = det_default_config();
+  void *arena;
+  size_t size;
+  int failed = 0;
+
+  if (cycles == 0) {
+    cycles = 50000;
+  }
+  cfg.classes = classes;
+  cfg.num_classes = 4;
+  size = det_alloc_size(&cfg);
+  arena = malloc(size);
+  if (arena == NULL) {
+    return 1;
+  }
+  memset(arena, 0, size); /* prefault */
+  det = det_alloc_init(arena, size, &cfg);
+  if (det == NULL) {
+    printf("det_alloc_init failed\n");
+    return 1;
+  }
+
+  printf("=== Control loop: 1 kHz, 8-%d messages/cycle living 1-%d cycles, "
+         "budget %llu us, %u cycles ===\n\n",
+         MAX_RX, WHEEL, (unsigned long long)(budget / 1000u), cycles);
+  printf("%-9s %-9s %9s %9s %9s %9s %8s\n", "engine", "time", "p50 ns",
+         "p99 ns", "p99.9 ns", "max ns", "misses");
+  failed |= run(&engines[0], cycles, budget);
+  failed |= run(&engines[1], cycles, budget);
+
+  det_alloc_destroy(det);
+  free(arena);
+  return failed;
+}
@@ -0,0 +1,147 @@
+/* freestanding.c - libdetalloc-freestanding linked without libc
+ *
+ * Built by `make freestanding-test` with -ffreestanding -nostdlib against
+ * lib/libdetalloc-freestanding.a, so any hosted dependency left in the core
+ * fails the link. It brings its own _start and write/exit system calls
+ * (x86-64 Linux only), checks alloc/free in plain and signal_safe mode, and
+ * reports the text size of the whole binary and the min/max cycles of
+ * det_alloc() and det_free().
+ *
+ * Usage: freestanding_test
+ */
+#include <detalloc.h>
+
+#define BLOCKS 256
+#define ROUNDS 64
+#define ARENA_SIZE (64 * 1024)
+
+/* Provided by the GNU linker script. */
+extern const char __executable_start[];
+extern const char etext[];
+
+static unsigned char arena[ARENA_SIZE] __attribute__((aligned(64)));
+static void *ptrs[BLOCKS];
+
+__asm__(".text\n"
+        ".global _start\n"
+        "_start:\n"
+        "  xor %rbp, %rbp\n"
+        "  and $-16, %rsp\n"
+        "  call fs_main\n"
+        "  mov %eax, %edi\n"
+        "  mov $60, %eax\n" /* exit */
+        "  syscall\n"
+        "  hlt\n");
+
+static void fs_write(const char *s, size_t n) {
+  long ret;
+
+  __asm__ __volatile__("syscall"
+                       : "=a"(ret)
+                       : "a"(1L), "D"(1L), "S"(s), "d"(n)
+                       : "rcx", "r11", "memory");
+  (void)ret;
+}
+
+static void fs_str(const char *s) {
+  size_t n = 0;
+
+  while (s[n] != '\0') {
+    n++;
+  }
+  fs_write(s, n);
+}
+
+static void fs_u64(uint64_t v) {
+  char digits[20];
+  size_t n = sizeof(digits);
+
+  do {
+    digits[--n] = (char)('0' + v % 10u);
+    v /= 10u;
+  } while (v != 0);
+  fs_write(digits + n, sizeof(digits) - n);
+}
+
+/* Fills and drains the pool ROUNDS times; returns 0 on success. */
+static int run(const char *name, bool signal_safe) {
+  det_config_t cfg = det_default_config();
+  det_allocator_t *alloc;
+  uint64_t amin = UINT64_MAX;
+  uint64_t amax = 0;
+  uint64_t fmin = UINT64_MAX;
+  uint64_t fmax = 0;
+  unsigned r;
+  unsigned i;
+
+  cfg.block_size = 48;
+  cfg.num_blocks = BLOCKS;
+  cfg.signal_safe = signal_safe;
+  alloc = det_alloc_init(arena, sizeof(arena), &cfg);
+  if (alloc == NULL) {
+    fs_str("init failed\n");
+    return 1;
+  }
+  for (r = 0; r < ROUNDS; r++) {
+    for (i = 0; i < BLOCKS; i++) {
+      uint64_t t0 = det_get_cycles();
+      uint64_t dt;
+
+      ptrs[i] = det_alloc(alloc);
+      dt = det_get_cycles() - t0;
+      if (ptrs[i] == NULL) {
+        fs_str("alloc failed\n");
+        return 1;
+      }
+      amin = dt < amin ? dt : amin;
+      amax = dt > amax ? dt : amax;
+    }
+    if (det_alloc(alloc) != NULL) {
+      fs_str("pool did not fill\n");
+      return 1;
+    }
+    for (i = 0; i < BLOCKS; i++) {
+      uint64_t t0 = det_get_cycles();
+      uint64_t dt;
+
+      det_free(alloc, ptrs[(i * 7u) % BLOCKS]);
+      dt = det_get_cycles() - t0;
+      fmin = dt < fmin ? dt : fmin;
+      fmax = dt > fmax ? dt : fmax;
+    }
+  }
+  fs_str(name);
+  fs_str("  alloc ");
+  fs_u64(amin);
+  fs_str("/");
+  fs_u64(amax);
+  fs_str("  free ");
+  fs_u64(fmin);
+  fs_str("/");
+  fs_u64(fmax);
+  fs_str(" cycles (min/max)\n");
+  return 0;
+}
+
+int fs_main(void);
+
+int fs_main(void) {
+  det_config_t cfg = det_default_config();
+
+  fs_str("freestanding detalloc: text ");
+  fs_u64((uint64_t)(etext - __executable_start));
+  fs_str(" bytes (whole binary)\n");
+
+  /* No lock in this build: thread_safe alone must be refused. */
+  cfg.block_size = 48;
+  cfg.num_blocks = BLOCKS;
+  cfg.thread_safe = true;
+  if (det_alloc_init(arena, sizeof(arena), &cfg) != NULL) {
+    fs_str("thread_safe accepted without a lock\n");
+    return 1;
+  }
+  if (run("plain      ", false) != 0 || run("signal_safe", true) != 0) {
+    return 1;
+  }
+  return 0;
+}
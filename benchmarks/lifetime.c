@@ -0,0 +1,186 @@
+/* lifetime.c - mixed vs lifetime-segregated placement
+ *
+ * Each round allocates a burst of short-lived request objects with a few
+ * long-lived session objects interleaved, then frees the burst. With one
+ * shared pool the survivors end up scattered over every page the bursts
+ * touched; with det_alloc_hint() they are packed into their own pool, and
+ * with a frame region the bursts cost a single det_frame_reset().
+ *
+ * Reported per placement, after the last burst is gone:
+ *   resident  pages of the arena that were ever touched (mincore)
+ *   pinned    pages holding at least one live object; only the rest could
+ *             ever be handed back to the OS
+ *   density   live bytes / pinned bytes (1 - external fragmentation)
+ *
+ * Usage: bench_lifetime [rounds]
+ */
+#define _DEFAULT_SOURCE
+
+#include <detalloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define OBJ_SIZE 96
+#define BURST 1024
+#define LONG_EVERY 128 /* one session object per this many requests */
+#define MAX_ROUNDS 256
+
+typedef enum { PLACE_MIXED, PLACE_SEGREGATED, PLACE_FRAME } placement_t;
+
+static const char *const place_name[] = {"mixed", "segregated",
+                                         "segregated+frame"};
+
+static int cmp_ptr(const void *a, const void *b) {
+  uintptr_t x = *(const uintptr_t *)a;
+  uintptr_t y = *(const uintptr_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static size_t resident_pages(void *base, size_t len, size_t page) {
+  size_t n = (len + page - 1) / page;
+  unsigned char *vec = malloc(n);
+  size_t res = 0;
+  size_t i;
+
+  if (vec == NULL || mincore(base, len, vec) != 0) {
+    free(vec);
+    return 0;
+  }
+  for (i = 0; i < n; i++) {
+    res += vec[i] & 1u;
+  }
+  free(vec);
+  return res;
+}
+
+static size_t pinned_pages(void **live, size_t n, size_t page) {
+  uintptr_t *pg = malloc(n * sizeof(*pg));
+  size_t pinned = 0;
+  size_t i;
+
+  if (pg == NULL) {
+    return 0;
+  }
+  for (i = 0; i < n; i++) {
+    pg[i] = (uintptr_t)live[i] / page;
+  }
+  qsort(pg, n, sizeof(*pg), cmp_ptr);
+  for (i = 0; i < n; i++) {
+    pinned += i == 0 || pg[i] != pg[i - 1];
+  }
+  free(pg);
+  return pinned;
+}
+
+static int run(placement_t place, int rounds, size_t page) {
+  size_t long_total = (size_t)rounds * (BURST / LONG_EVERY);
+  det_class_config_t cls[2];
+  det_config_t cfg = det_default_config();
+  void *burst[BURST];
+  void **live;
+  size_t n_live = 0;
+  det_allocator_t *alloc;
+  det_lifetime_t short_hint;
+  uint8_t *arena;
+  size_t size;
+  size_t pinned;
+  int r;
+  int i;
+
+  memset(cls, 0, sizeof(cls));
+  if (place == PLACE_MIXED) {
+    cls[0].block_size = OBJ_SIZE;
+    cls[0].num_blocks = BURST + long_total;
+    cfg.num_classes = 1;
+    short_hint = DET_LIFETIME_ANY;
+  } else {
+    cls[0].block_size = OBJ_SIZE;
+    cls[0].num_blocks = BURST;
+    cls[0].lifetime = DET_LIFETIME_SHORT;
+    cls[1].block_size = OBJ_SIZE;
+    cls[1].num_blocks = long_total;
+    cls[1].lifetime = DET_LIFETIME_LONG;
+    cfg.num_classes = 2;
+    short_hint = DET_LIFETIME_SHORT;
+  }
+  if (place == PLACE_FRAME) {
+    cls[0] = cls[1];
+    cfg.num_classes = 1;
+    cfg.frame_size = (size_t)BURST * OBJ_SIZE;
+    short_hint = DET_LIFETIME_FRAME;
+  }
+  cfg.classes = cls;
+
+  size = det_alloc_size(&cfg);
+  arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+  live = malloc(long_total * sizeof(*live));
+  if (arena == MAP_FAILED || live == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  alloc = det_alloc_init(arena, size, &cfg);
+  if (alloc == NULL) {
+    fprintf(stderr, "det_alloc_init failed\n");
+    return 1;
+  }
+
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < BURST; i++) {
+      burst[i] = det_alloc_hint(alloc, OBJ_SIZE, short_hint);
+      if (burst[i] != NULL) {
+        memset(burst[i], 0xA5, OBJ_SIZE);
+      }
+      if (i % LONG_EVERY == LONG_EVERY / 2) {
+        void *obj = det_alloc_hint(alloc, OBJ_SIZE, DET_LIFETIME_LONG);
+
+        if (obj == NULL) {
+          fprintf(stderr, "long-lived allocation failed\n");
+          return 1;
+        }
+        memset(obj, 0x5A, OBJ_SIZE);
+        live[n_live++] = obj;
+      }
+    }
+    /* Free in a shuffled order, as request completion would. */
+    for (i = 0; i < BURST; i++) {
+      det_free(alloc, burst[(i * 7 + r) % BURST]);
+    }
+    if (place == PLACE_FRAME) {
+      det_frame_reset(alloc);
+    }
+  }
+
+  pinned = pinned_pages(live, n_live, page);
+  printf("  %-17s %8zu %8zu %8.2f\n", place_name[place],
+         resident_pages(arena, size, page), pinned,
+         pinned != 0 ? (double)(n_live * OBJ_SIZE) / (double)(pinned * page)
+                     : 0.0);
+
+  det_alloc_destroy(alloc);
+  free(live);
+  munmap(arena, size);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 32;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+  if (rounds < 1 || rounds > MAX_ROUNDS) {
+    fprintf(stderr, "rounds must be in 1..%d\n", MAX_ROUNDS);
+    return 1;
+  }
+  printf("=== Lifetime Placement (%d rounds, %d x %d B requests, "
+         "1 in %d long-lived) ===\n",
+         rounds, BURST, OBJ_SIZE, LONG_EVERY);
+  printf("  %-17s %8s %8s %8s\n", "placement", "resident", "pinned",
+         "density");
+  return run(PLACE_MIXED, rounds, page) ||
+         run(PLACE_SEGREGATED, rounds, page) || run(PLACE_FRAME, rounds, page);
+}
@@ -0,0 +1,249 @@
+/* migrate.c - det_alloc_migrate() pause versus arena size and live set
+ *
+ * Fills a pool of 64-byte blocks, frees every other block of the filled
+ * prefix to leave holes, attaches a few handles, then migrates it into an
+ * arena with twice the capacity. The first table keeps the live set fixed
+ * and grows the arena; the second keeps the arena fixed and grows the live
+ * set. The pause should follow the second and not the first.
+ *
+ * The new arena is mapped with MAP_POPULATE before the clock starts, so the
+ * pause does not include first-touch page faults (prefault the target
+ * the same way ahead of the quiescent point in a real system).
+ *
+ * Every run checks that live contents, handles and the frame region survive,
+ * and that the migrated allocator can free and allocate again.
+ *
+ * Usage: bench_migrate [reps]
+ */
+#define _DEFAULT_SOURCE
+
+#include <detalloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define BLOCK 64
+#define HANDLES 256
+#define FRAME (64 * 1024)
+#define MAX_REPS 64
+
+typedef struct {
+  void *mem;
+  size_t size;
+  det_allocator_t *alloc;
+} arena_t;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static det_config_t make_cfg(size_t blocks) {
+  det_config_t cfg = det_default_config();
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = blocks;
+  cfg.num_handles = HANDLES;
+  cfg.frame_size = FRAME;
+  return cfg;
+}
+
+static int arena_map(arena_t *a, const det_config_t *cfg, int flags) {
+  a->size = det_alloc_size(cfg);
+  a->mem = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  a->alloc = NULL;
+  return a->mem == MAP_FAILED ? -1 : 0;
+}
+
+static void arena_unmap(arena_t *a) {
+  munmap(a->mem, a->size);
+}
+
+static void fill(void *p, size_t tag) {
+  memset(p, (int)(tag * 31u + 7u), BLOCK);
+}
+
+static int check(const void *p, size_t tag) {
+  const unsigned char *b = (const unsigned char *)p;
+  size_t i;
+
+  for (i = 0; i < BLOCK; i++) {
+    if (b[i] != (unsigned char)(tag * 31u + 7u)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* One migration of @p live blocks out of a pool of @p blocks; returns the
+ * pause in ns, or 0 on a failed check. */
+static uint64_t run(size_t blocks, size_t live) {
+  det_config_t ocfg = make_cfg(blocks);
+  det_config_t ncfg = make_cfg(blocks * 2);
+  arena_t old_a;
+  arena_t new_a;
+  void **ptrs;
+  det_handle_t handles[HANDLES];
+  char *frame;
+  uint64_t t0;
+  uint64_t dt = 0;
+  size_t i;
+
+  ptrs = malloc(2 * live * sizeof(*ptrs));
+  if (ptrs == NULL || arena_map(&old_a, &ocfg, 0) != 0) {
+    free(ptrs);
+    return 0;
+  }
+  if (arena_map(&new_a, &ncfg, MAP_POPULATE) != 0) {
+    arena_unmap(&old_a);
+    free(ptrs);
+    return 0;
+  }
+  old_a.alloc = det_alloc_init(old_a.mem, old_a.size, &ocfg);
+  if (old_a.alloc == NULL) {
+    goto out;
+  }
+  for (i = 0; i < 2 * live; i++) {
+    ptrs[i] = det_alloc(old_a.alloc);
+    if (ptrs[i] == NULL) {
+      goto out;
+    }
+    fill(ptrs[i], i);
+  }
+  for (i = 0; i < 2 * live; i += 2) {
+    det_free(old_a.alloc, ptrs[i]);
+  }
+  for (i = 0; i < HANDLES; i++) {
+    handles[i] = det_handle_alloc(old_a.alloc, BLOCK);
+    if (handles[i] == DET_HANDLE_NULL) {
+      goto out;
+    }
+    fill(det_handle_get(old_a.alloc, handles[i]), i);
+  }
+  frame = det_alloc_hint(old_a.alloc, 100, DET_LIFETIME_FRAME);
+  if (frame == NULL) {
+    goto out;
+  }
+  strcpy(frame, "frame survives");
+
+  t0 = now_ns();
+  new_a.alloc = det_alloc_migrate(old_a.alloc, new_a.mem, new_a.size, &ncfg);
+  dt = now_ns() - t0;
+  if (new_a.alloc == NULL) {
+    dt = 0;
+    goto out;
+  }
+
+  for (i = 1; i < 2 * live; i += 2) {
+    void *p = det_alloc_relocate(old_a.alloc, new_a.alloc, ptrs[i]);
+
+    if (p == NULL || check(p, i) != 0) {
+      dt = 0;
+      goto out;
+    }
+    ptrs[i] = p;
+  }
+  for (i = 0; i < HANDLES; i++) {
+    void *p = det_handle_get(new_a.alloc, handles[i]);
+
+    if (p == NULL || check(p, i) != 0) {
+      dt = 0;
+      goto out;
+    }
+    det_handle_free(new_a.alloc, handles[i]);
+  }
+  frame = det_alloc_relocate(old_a.alloc, new_a.alloc, frame);
+  if (frame == NULL || strcmp(frame, "frame survives") != 0) {
+    dt = 0;
+    goto out;
+  }
+  for (i = 1; i < 2 * live; i += 2) {
+    det_free(new_a.alloc, ptrs[i]);
+  }
+  /* The holes, the freed blocks and the new half must all be usable. */
+  for (i = 0; i < blocks * 2; i++) {
+    if (det_alloc(new_a.alloc) == NULL) {
+      dt = 0;
+      goto out;
+    }
+  }
+  if (det_alloc(new_a.alloc) != NULL) {
+    dt = 0;
+  }
+
+out:
+  arena_unmap(&new_a);
+  arena_unmap(&old_a);
+  free(ptrs);
+  return dt;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Median pause in ns over @p reps runs, or 0 if any run failed. */
+static uint64_t median(size_t blocks, size_t live, int reps) {
+  uint64_t t[MAX_REPS];
+  int r;
+
+  for (r = 0; r < reps; r++) {
+    t[r] = run(blocks, live);
+    if (t[r] == 0) {
+      return 0;
+    }
+  }
+  qsort(t, (size_t)reps, sizeof(t[0]), cmp_u64);
+  return t[reps / 2];
+}
+
+static int row(size_t blocks, size_t live, int reps) {
+  uint64_t ns = median(blocks, live, reps);
+
+  if (ns == 0) {
+    printf("%10zu %10zu   FAILED\n", blocks, live);
+    return 1;
+  }
+  printf("%10zu %10zu %9.1f %10.1f\n", blocks, live,
+         (double)(blocks * BLOCK) / (1024.0 * 1024.0), (double)ns / 1000.0);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int reps = argc > 1 ? atoi(argv[1]) : 5;
+  int failed = 0;
+  size_t blocks;
+  size_t live;
+
+  if (reps < 1 || reps > MAX_REPS) {
+    reps = 5;
+  }
+
+  printf("=== det_alloc_migrate: %d-byte blocks, %d handles, "
+         "median of %d ===\n\n",
+         BLOCK, HANDLES, reps);
+
+  printf("Fixed live set, growing arena:\n");
+  printf("%10s %10s %9s %10s\n", "blocks", "live", "old MiB", "pause us");
+  for (blocks = (size_t)1 << 14; blocks <= (size_t)1 << 21; blocks <<= 1) {
+    failed |= row(blocks, 4096, reps);
+  }
+
+  printf("\nFixed arena, growing live set:\n");
+  printf("%10s %10s %9s %10s\n", "blocks", "live", "old MiB", "pause us");
+  for (live = 1024; live <= 65536; live <<= 1) {
+    failed |= row((size_t)1 << 20, live, reps);
+  }
+
+  printf("\n%s\n", failed ? "FAIL" : "PASS");
+  return failed;
+}
@@ -0,0 +1,233 @@
+/* pool_set.cpp - compile-time class routing with det::pool_set
+ *
+ * Three message types of 24, 100 and 200 bytes are created and destroyed in
+ * batches through three paths: new/delete, a three-class detalloc instance
+ * routed at run time (det_alloc_sized() + placement new, det_free()), and
+ * det::make_pooled<T>() on a pool_set<64, 128, 256>, which picks the class
+ * at compile time and frees through a stateless deleter. Reported: mean
+ * cycles per create and per destroy (best of several rounds, one
+ * det_get_cycles() pair per batch).
+ *
+ * Also checks that each type lands in the class the compiler picked, that
+ * pooled_ptr is no larger than a raw pointer and that an exhausted class
+ * yields an empty pointer, and prints PASS or FAIL.
+ *
+ * Usage: bench_pool_set [rounds]
+ */
+#include <detalloc.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#define BATCH 1024
+
+namespace {
+
+struct small_msg {
+  unsigned id;
+  char body[20];
+  explicit small_msg(unsigned n) : id(n) { std::memset(body, 0, 20); }
+};
+
+struct medium_msg {
+  unsigned id;
+  char body[96];
+  explicit medium_msg(unsigned n) : id(n) { std::memset(body, 0, 96); }
+};
+
+struct large_msg {
+  unsigned id;
+  char body[196];
+  explicit large_msg(unsigned n) : id(n) { std::memset(body, 0, 196); }
+};
+
+typedef det::pool_set<64, 128, 256> set_t;
+
+static_assert(set_t::class_of(sizeof(small_msg)) == 0, "small -> 64");
+static_assert(set_t::class_of(sizeof(medium_msg)) == 1, "medium -> 128");
+static_assert(set_t::class_of(sizeof(large_msg)) == 2, "large -> 256");
+static_assert(sizeof(det::pooled_ptr<large_msg, set_t>) == sizeof(void *),
+              "pooled_ptr carries no state");
+
+small_msg *small_ptrs[BATCH];
+medium_msg *medium_ptrs[BATCH];
+large_msg *large_ptrs[BATCH];
+det::pooled_ptr<small_msg, set_t> small_pooled[BATCH];
+det::pooled_ptr<medium_msg, set_t> medium_pooled[BATCH];
+det::pooled_ptr<large_msg, set_t> large_pooled[BATCH];
+
+struct result {
+  double create;
+  double destroy;
+};
+
+void keep_best(result &best, uint64_t t0, uint64_t t1, uint64_t t2) {
+  double c = static_cast<double>(t1 - t0) / (3 * BATCH);
+  double d = static_cast<double>(t2 - t1) / (3 * BATCH);
+
+  best.create = c < best.create ? c : best.create;
+  best.destroy = d < best.destroy ? d : best.destroy;
+}
+
+bool run_new(unsigned rounds, result &best) {
+  for (unsigned r = 0; r < rounds; r++) {
+    uint64_t t0 = det_get_cycles();
+
+    for (unsigned i = 0; i < BATCH; i++) {
+      small_ptrs[i] = new small_msg(i);
+      medium_ptrs[i] = new medium_msg(i);
+      large_ptrs[i] = new large_msg(i);
+    }
+    uint64_t t1 = det_get_cycles();
+    for (unsigned i = 0; i < BATCH; i++) {
+      delete small_ptrs[i];
+      delete medium_ptrs[i];
+      delete large_ptrs[i];
+    }
+    keep_best(best, t0, t1, det_get_cycles());
+  }
+  return true;
+}
+
+template <class T> T *sized_new(det_allocator_t *alloc, unsigned n) {
+  void *mem = det_alloc_sized(alloc, sizeof(T));
+
+  return mem != nullptr ? ::new (mem) T(n) : nullptr;
+}
+
+template <class T> void sized_delete(det_allocator_t *alloc, T *obj) {
+  obj->~T();
+  det_free(alloc, obj);
+}
+
+bool run_sized(det_allocator_t *alloc, unsigned rounds, result &best) {
+  for (unsigned r = 0; r < rounds; r++) {
+    uint64_t t0 = det_get_cycles();
+
+    for (unsigned i = 0; i < BATCH; i++) {
+      small_ptrs[i] = sized_new<small_msg>(alloc, i);
+      medium_ptrs[i] = sized_new<medium_msg>(alloc, i);
+      large_ptrs[i] = sized_new<large_msg>(alloc, i);
+    }
+    uint64_t t1 = det_get_cycles();
+    for (unsigned i = 0; i < BATCH; i++) {
+      if (small_ptrs[i] == nullptr || medium_ptrs[i] == nullptr ||
+          large_ptrs[i] == nullptr) {
+        return false;
+      }
+      sized_delete(alloc, small_ptrs[i]);
+      sized_delete(alloc, medium_ptrs[i]);
+      sized_delete(alloc, large_ptrs[i]);
+    }
+    keep_best(best, t0, t1, det_get_cycles());
+  }
+  return true;
+}
+
+bool run_pooled(set_t &set, unsigned rounds, result &best) {
+  for (unsigned r = 0; r < rounds; r++) {
+    uint64_t t0 = det_get_cycles();
+
+    for (unsigned i = 0; i < BATCH; i++) {
+      small_pooled[i] = det::make_pooled<small_msg>(set, i);
+      medium_pooled[i] = det::make_pooled<medium_msg>(set, i);
+      large_pooled[i] = det::make_pooled<large_msg>(set, i);
+    }
+    uint64_t t1 = det_get_cycles();
+    for (unsigned i = 0; i < BATCH; i++) {
+      if (!small_pooled[i] || !medium_pooled[i] || !large_pooled[i]) {
+        return false;
+      }
+      small_pooled[i].reset();
+      medium_pooled[i].reset();
+      large_pooled[i].reset();
+    }
+    keep_best(best, t0, t1, det_get_cycles());
+  }
+  return true;
+}
+
+/* Each type in its compile-time class, and a full class fails cleanly. */
+bool check(set_t &set) {
+  det::pooled_ptr<small_msg, set_t> a = det::make_pooled<small_msg>(set, 1u);
+  det::pooled_ptr<large_msg, set_t> b = det::make_pooled<large_msg>(set, 2u);
+  bool ok = a && b && a->id == 1 && b->id == 2 &&
+            det_alloc_usable_size(set.pool(0), a.get()) == 64 &&
+            det_alloc_usable_size(set.pool(2), b.get()) == 256;
+
+  a.reset();
+  b.reset();
+  for (unsigned i = 0; i < BATCH; i++) {
+    medium_pooled[i] = det::make_pooled<medium_msg>(set, i);
+    ok = ok && medium_pooled[i];
+  }
+  ok = ok && !det::make_pooled<medium_msg>(set, 0u);
+  for (unsigned i = 0; i < BATCH; i++) {
+    medium_pooled[i].reset();
+  }
+  return ok && det::make_pooled<medium_msg>(set, 0u) != nullptr;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  static const det_class_config_t classes[] = {
+      {64, BATCH, DET_LIFETIME_ANY, 0},
+      {128, BATCH, DET_LIFETIME_ANY, 0},
+      {256, BATCH, DET_LIFETIME_ANY, 0}};
+  unsigned rounds = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 200;
+  det_config_t cfg = det_default_config();
+  std::size_t set_size = set_t::arena_size(BATCH);
+  std::size_t size;
+  result r_new = {1e30, 1e30};
+  result r_sized = {1e30, 1e30};
+  result r_pooled = {1e30, 1e30};
+  bool ok;
+
+  if (rounds == 0) {
+    rounds = 200;
+  }
+  cfg.classes = classes;
+  cfg.num_classes = 3;
+  size = det_alloc_size(&cfg);
+
+  void *arena = std::malloc(size);
+  void *set_arena = std::malloc(set_size);
+
+  if (arena == nullptr || set_arena == nullptr || set_size == 0) {
+    return 1;
+  }
+  std::memset(arena, 0, size);
+  std::memset(set_arena, 0, set_size);
+  det_allocator_t *alloc = det_alloc_init(arena, size, &cfg);
+  {
+    set_t set(set_arena, set_size, BATCH);
+
+    if (alloc == nullptr || !set.valid()) {
+      std::printf("init failed\n");
+      return 1;
+    }
+    ok = run_new(rounds, r_new) && run_sized(alloc, rounds, r_sized) &&
+         run_pooled(set, rounds, r_pooled) && check(set);
+  }
+
+  std::printf("=== pool_set<64, 128, 256>: 24/100/200-byte objects, batches "
+              "of %d x 3 ===\n\n",
+              BATCH);
+  std::printf("Cycles per object (best of %u rounds):\n", rounds);
+  std::printf("%-22s %10s %10s\n", "path", "create", "destroy");
+  std::printf("%-22s %10.1f %10.1f\n", "new/delete", r_new.create,
+              r_new.destroy);
+  std::printf("%-22s %10.1f %10.1f\n", "det_alloc_sized", r_sized.create,
+              r_sized.destroy);
+  std::printf("%-22s %10.1f %10.1f\n", "make_pooled", r_pooled.create,
+              r_pooled.destroy);
+
+  det_alloc_destroy(alloc);
+  std::free(arena);
+  std::free(set_arena);
+  std::printf("\n%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/* rtprepare.c - first-cycle latency with and without det_rt_prepare()
+ *
+ * A fresh process maps a fresh arena, initialises a four-class allocator
+ * and runs cycles that take 64 blocks of each class, write them and free
+ * them again. The first cycle is the one a real-time loop pays for at
+ * start-up: every metadata and payload page it touches is new, and every
+ * det_* function it calls may still have to be bound by the dynamic linker.
+ *
+ * Three modes, each in its own freshly exec'd process so nothing is warm:
+ * plain; det_rt_prepare(DET_RT_ALL) after init; and the same with
+ * LD_BIND_NOW=1, which also removes lazy binding from the program (the
+ * library itself is linked with -z now). Reported per mode: the risks
+ * det_rt_prepare() left, the very first det_alloc(), the allocator time and
+ * the whole time of the first cycle with its minor page faults, and a
+ * later cycle for reference.
+ *
+ * Checks that prepared modes take no page fault in the first cycle and that
+ * LD_BIND_NOW clears the lazy-binding risk, and prints PASS or FAIL.
+ *
+ * Usage: bench_rtprepare [blocks per class]
+ */
+#define _DEFAULT_SOURCE
+
+#include <detalloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CLASSES 4
+#define PER_CYCLE 64
+#define WARM_CYCLES 100
+
+static void *live[CLASSES * PER_CYCLE];
+static unsigned char scratch[512];
+
+static const char *const mode_names[] = {"plain", "rt_prepare",
+                                         "rt_prepare+BIND_NOW"};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static long minor_faults(void) {
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_minflt;
+}
+
+static void risk_names(unsigned risks, char *buf, size_t len) {
+  static const char *const names[] = {"arena-unlocked", "code-unlocked",
+                                      "lazy-binding", "uncommitted",
+                                      "unsupported"};
+  size_t i;
+
+  snprintf(buf, len, "%s", risks == 0 ? "none" : "");
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if ((risks & (1u << i)) != 0) {
+      size_t used = strlen(buf);
+
+      snprintf(buf + used, len - used, "%s%s", used != 0 ? "," : "",
+               names[i]);
+    }
+  }
+}
+
+/* One cycle; *alloc_ns receives the time spent in det_alloc()/det_free(),
+ * *first_ns that of the cycle's first det_alloc(). Returns the whole time,
+ * 0 if an allocation failed. */
+static uint64_t cycle(det_allocator_t *det, uint64_t *alloc_ns,
+                      uint64_t *first_ns) {
+  uint64_t t0 = now_ns();
+  uint64_t ta;
+  size_t i;
+
+  *alloc_ns = 0;
+  for (i = 0; i < CLASSES * PER_CYCLE; i++) {
+    size_t size = (size_t)64 << (i % CLASSES);
+
+    ta = now_ns();
+    live[i] = det_alloc_sized(det, size);
+    ta = now_ns() - ta;
+    *alloc_ns += ta;
+    if (i == 0) {
+      *first_ns = ta;
+    }
+    if (live[i] == NULL) {
+      return 0;
+    }
+    memset(live[i], (int)i, size);
+  }
+  for (i = 0; i < CLASSES * PER_CYCLE; i++) {
+    ta = now_ns();
+    det_free(det, live[i]);
+    *alloc_ns += now_ns() - ta;
+  }
+  return now_ns() - t0;
+}
+
+/* Runs in a fresh process: prints one row, exits non-zero on a failed
+ * check. */
+static int child(int mode, size_t blocks) {
+  det_class_config_t classes[CLASSES];
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  unsigned risks = 0;
+  uint64_t first_call;
+  uint64_t first_alloc;
+  uint64_t warm_alloc;
+  uint64_t warm_ns = 0;
+  uint64_t unused;
+  uint64_t total;
+  char names[96];
+  long faults;
+  size_t size;
+  void *mem;
+  int i;
+
+  for (i = 0; i < CLASSES; i++) {
+    classes[i].block_size = (size_t)64 << i;
+    classes[i].num_blocks = blocks;
+    classes[i].lifetime = DET_LIFETIME_ANY;
+    classes[i].align = 0;
+  }
+  cfg.classes = classes;
+  cfg.num_classes = CLASSES;
+  size = det_alloc_size(&cfg);
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  if (mem == MAP_FAILED) {
+    return 1;
+  }
+  det = det_alloc_init(mem, size, &cfg);
+  if (det == NULL) {
+    return 1;
+  }
+  if (mode != 0 && det_rt_prepare(det, DET_RT_ALL, &risks) != DET_OK) {
+    return 1;
+  }
+
+  /* The benchmark's own first touches: its array, memset(), the clock. */
+  memset(live, 0, sizeof(live));
+  memset(scratch, 1, sizeof(scratch));
+  (void)now_ns();
+  faults = minor_faults();
+  total = cycle(det, &first_alloc, &first_call);
+  faults = minor_faults() - faults;
+  for (i = 0; i < WARM_CYCLES; i++) {
+    warm_ns = cycle(det, &warm_alloc, &unused);
+  }
+  if (total == 0 || warm_ns == 0) {
+    printf("%-20s allocation failed\n", mode_names[mode]);
+    return 1;
+  }
+  if (mode == 0) {
+    snprintf(names, sizeof(names), "(not checked)");
+  } else {
+    risk_names(risks, names, sizeof(names));
+  }
+  printf("%-20s %9llu %10.1f %10.1f %7ld %10.1f  %s\n", mode_names[mode],
+         (unsigned long long)first_call, (double)first_alloc / 1e3,
+         (double)total / 1e3, faults, (double)warm_ns / 1e3, names);
+  det_alloc_destroy(det);
+  munmap(mem, size);
+  if (mode != 0 && faults != 0) {
+    return 1;
+  }
+  return mode == 2 && (risks & DET_RT_RISK_LAZY_BINDING) != 0;
+}
+
+int main(int argc, char **argv) {
+  size_t blocks = 4096;
+  int mode;
+  int failed = 0;
+
+  if (argc > 3 && strcmp(argv[1], "--child") == 0) {
+    blocks = (size_t)strtoul(argv[3], NULL, 10);
+    return child(atoi(argv[2]), blocks);
+  }
+  if (argc > 1 && atoi(argv[1]) > 0) {
+    blocks = (size_t)atoi(argv[1]);
+  }
+
+  printf("=== First cycle: %d x %d blocks of 64-512 bytes, fresh process "
+         "and arena, %zu blocks per class ===\n\n",
+         CLASSES, PER_CYCLE, blocks);
+  printf("%-20s %9s %10s %10s %7s %10s  %s\n", "mode", "1st ns",
+         "alloc us", "cycle us", "faults", "warm us", "risks left");
+  fflush(stdout);
+  for (mode = 0; mode < 3; mode++) {
+    char mode_arg[4];
+    char blocks_arg[24];
+    int status;
+    pid_t pid;
+
+    snprintf(mode_arg, sizeof(mode_arg), "%d", mode);
+    snprintf(blocks_arg, sizeof(blocks_arg), "%zu", blocks);
+    pid = fork();
+    if (pid == 0) {
+      char *args[5];
+
+      args[0] = argv[0];
+      args[1] = "--child";
+      args[2] = mode_arg;
+      args[3] = blocks_arg;
+      args[4] = NULL;
+      if (mode == 2) {
+        setenv("LD_BIND_NOW", "1", 1);
+      } else {
+        unsetenv("LD_BIND_NOW");
+      }
+      execv("/proc/self/exe", args);
+      _exit(1);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      printf("%-20s check failed\n", mode_names[mode]);
+      failed = 1;
+    }
+  }
+
+  printf("\n%s\n", failed ? "FAIL" : "PASS");
+  return failed;
+}
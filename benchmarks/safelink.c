@@ -0,0 +1,222 @@
+/* safelink.c - cost and effect of safe_linking
+ *
+ * Cost: a 64-byte pool is drained and refilled in a shuffled order, so the
+ * free list is scattered, and the mean cycles per det_alloc() and det_free()
+ * are reported with safe_linking off and on, in plain and signal_safe mode
+ * (best of several rounds, one det_get_cycles() pair per batch).
+ *
+ * Effect: with every block allocated, one block is freed and a simulated
+ * overflow from its lower neighbour rewrites the free block's link so that
+ * it names an allocated victim block. Two allocations later the victim is
+ * handed out twice unless the link was rejected. Pops reject a link to a
+ * block in use in every mode, so no trial may hand out a live block. Each
+ * trial re-initialises the allocator, so safe_linking draws a new secret
+ * every time; a mangled forgery that decodes to 0 ends the list without a
+ * fault (1 in 65536 here: 16-bit links), which the "other" column
+ * counts.
+ *
+ * Usage: bench_safelink [trials]
+ */
+#define _DEFAULT_SOURCE
+
+#include <detalloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define BLOCK 64
+#define BLOCKS 4096
+#define ROUNDS 200
+#define VICTIM 5
+
+static void *ptrs[BLOCKS];
+static size_t order[BLOCKS];
+
+static det_allocator_t *make(void *mem, size_t size, bool signal_safe,
+                             bool safe_linking) {
+  det_config_t cfg = det_default_config();
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.signal_safe = signal_safe;
+  cfg.safe_linking = safe_linking;
+  return det_alloc_init(mem, size, &cfg);
+}
+
+static void shuffle(void) {
+  size_t i;
+
+  for (i = 0; i < BLOCKS; i++) {
+    order[i] = i;
+  }
+  for (i = BLOCKS - 1; i > 0; i--) {
+    size_t j = (size_t)rand() % (i + 1);
+    size_t t = order[i];
+
+    order[i] = order[j];
+    order[j] = t;
+  }
+}
+
+/* Best-of-ROUNDS mean cycles per alloc and per free; -1 on failure. */
+static int cost(void *mem, size_t size, bool signal_safe, bool safe_linking,
+                double *alloc_cy, double *free_cy) {
+  det_allocator_t *alloc = make(mem, size, signal_safe, safe_linking);
+  uint64_t best_a = UINT64_MAX;
+  uint64_t best_f = UINT64_MAX;
+  unsigned r;
+  size_t i;
+
+  if (alloc == NULL) {
+    return -1;
+  }
+  srand(1);
+  for (r = 0; r < ROUNDS; r++) {
+    uint64_t t0;
+    uint64_t t1;
+    uint64_t t2;
+
+    shuffle();
+    t0 = det_get_cycles();
+    for (i = 0; i < BLOCKS; i++) {
+      ptrs[i] = det_alloc(alloc);
+    }
+    t1 = det_get_cycles();
+    for (i = 0; i < BLOCKS; i++) {
+      det_free(alloc, ptrs[order[i]]);
+    }
+    t2 = det_get_cycles();
+    for (i = 0; i < BLOCKS; i++) {
+      if (ptrs[i] == NULL) {
+        return -1;
+      }
+    }
+    best_a = t1 - t0 < best_a ? t1 - t0 : best_a;
+    best_f = t2 - t1 < best_f ? t2 - t1 : best_f;
+  }
+  *alloc_cy = (double)best_a / BLOCKS;
+  *free_cy = (double)best_f / BLOCKS;
+  return 0;
+}
+
+typedef struct {
+  unsigned detected; /* link dropped and counted */
+  unsigned hijacked; /* a live block was handed out again */
+  unsigned other;    /* the list ended without a fault */
+} outcome_t;
+
+/* One simulated overflow; returns -1 on an unexpected failure. */
+static int attack(void *mem, size_t size, bool signal_safe, bool safe_linking,
+                  outcome_t *out) {
+  det_allocator_t *alloc = make(mem, size, signal_safe, safe_linking);
+  det_stats_t stats;
+  unsigned char *hole;
+  unsigned char *next;
+  uint16_t forged = VICTIM + 1; /* raw index + 1 of the victim */
+  size_t i;
+
+  if (alloc == NULL) {
+    return -1;
+  }
+  for (i = 0; i < BLOCKS; i++) {
+    ptrs[i] = det_alloc(alloc);
+    if (ptrs[i] == NULL) {
+      return -1;
+    }
+  }
+  hole = ptrs[BLOCKS / 2];
+  det_free(alloc, hole);
+  /* Pools of up to 65535 blocks store 16-bit links. */
+  memcpy(hole, &forged, sizeof(forged));
+
+  if (det_alloc(alloc) != hole) {
+    return -1;
+  }
+  next = det_alloc(alloc);
+  if (det_get_stats(alloc, &stats) != DET_OK) {
+    return -1;
+  }
+  /* The pool is full, so a dropped link leaves nothing to hand out. */
+  if (next != NULL) {
+    out->hijacked++;
+  } else if (stats.pool_stats[0].link_faults == 1) {
+    out->detected++;
+  } else {
+    out->other++;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  unsigned trials = argc > 1 ? (unsigned)atoi(argv[1]) : 10000;
+  det_config_t cfg = det_default_config();
+  size_t size;
+  void *mem;
+  int m;
+  int failed = 0;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  size = det_alloc_size(&cfg);
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  if (trials == 0) {
+    trials = 10000;
+  }
+
+  printf("=== safe_linking: %d x %d-byte blocks ===\n\n", BLOCKS, BLOCK);
+  printf("Cycles per call, shuffled frees (best of %d rounds):\n", ROUNDS);
+  printf("%-12s %10s %10s %10s %10s\n", "mode", "alloc", "alloc+sl",
+         "free", "free+sl");
+  for (m = 0; m < 2; m++) {
+    double a0;
+    double a1;
+    double f0;
+    double f1;
+
+    if (cost(mem, size, m != 0, false, &a0, &f0) != 0 ||
+        cost(mem, size, m != 0, true, &a1, &f1) != 0) {
+      printf("%-12s FAILED\n", m != 0 ? "signal_safe" : "plain");
+      failed = 1;
+      continue;
+    }
+    printf("%-12s %10.1f %10.1f %10.1f %10.1f\n",
+           m != 0 ? "signal_safe" : "plain", a0, a1, f0, f1);
+  }
+
+  printf("\nForged link to an allocated block, %u trials:\n", trials);
+  printf("%-12s %-5s %10s %10s %10s\n", "mode", "sl", "detected",
+         "hijacked", "other");
+  for (m = 0; m < 4; m++) {
+    outcome_t out = {0, 0, 0};
+    bool signal_safe = (m & 2) != 0;
+    bool safe_linking = (m & 1) != 0;
+    unsigned t;
+
+    for (t = 0; t < trials; t++) {
+      if (attack(mem, size, signal_safe, safe_linking, &out) != 0) {
+        failed = 1;
+        break;
+      }
+    }
+    printf("%-12s %-5s %10u %10u %10u\n",
+           signal_safe ? "signal_safe" : "plain", safe_linking ? "on" : "off",
+           out.detected, out.hijacked, out.other);
+    /* Without mangling the forged link names the victim and is always
+     * caught; a mangled one may rarely decode to an empty list. */
+    if (out.hijacked != 0 || (!safe_linking && out.detected != trials) ||
+        out.other > trials / 100) {
+      failed = 1;
+    }
+  }
+
+  munmap(mem, size);
+  printf("\n%s\n", failed ? "FAIL" : "PASS");
+  return failed;
+}
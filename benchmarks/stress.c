@@ -0,0 +1,216 @@
+/* stress.c - signal storm against a signal_safe pool
+ *
+ * Worker threads run allocation storms while a signaler thread fires SIGUSR1
+ * at them back-to-back and an interval timer adds SIGALRM on top. Both
+ * handlers allocate, stamp, verify and free blocks from the same pool, so
+ * handlers regularly interrupt det_alloc()/det_free() mid-operation on the
+ * thread they run on. At the end the pool must drain to exactly num_blocks
+ * distinct blocks.
+ *
+ * Usage: bench_stress [seconds]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <detalloc.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define NUM_BLOCKS 4096
+#define BLOCK_SIZE 64
+#define NUM_WORKERS 2
+#define WORKER_BATCH 64
+#define HANDLER_BATCH 4
+
+static uint8_t arena[NUM_BLOCKS * (BLOCK_SIZE + 1) + 4096];
+static det_allocator_t *pool;
+static volatile int running = 1;
+static pthread_t workers[NUM_WORKERS];
+
+static unsigned long handler_runs;
+static unsigned long handler_misses;
+static unsigned long corruptions;
+
+static void stamp(void *blk, uint64_t cookie) {
+  uint64_t *w = (uint64_t *)blk;
+  size_t i;
+
+  for (i = 0; i < BLOCK_SIZE / sizeof(uint64_t); i++) {
+    w[i] = cookie + i;
+  }
+}
+
+static int check(const void *blk, uint64_t cookie) {
+  const uint64_t *w = (const uint64_t *)blk;
+  size_t i;
+
+  for (i = 0; i < BLOCK_SIZE / sizeof(uint64_t); i++) {
+    if (w[i] != cookie + i) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void on_signal(int sig) {
+  void *blk[HANDLER_BATCH];
+  uint64_t cookie = ((uint64_t)sig << 56) ^ (uint64_t)(uintptr_t)&blk;
+  int i;
+
+  for (i = 0; i < HANDLER_BATCH; i++) {
+    blk[i] = det_alloc(pool);
+    if (blk[i] == NULL) {
+      __atomic_fetch_add(&handler_misses, 1, __ATOMIC_RELAXED);
+    } else {
+      stamp(blk[i], cookie + (uint64_t)i * 1024u);
+    }
+  }
+  for (i = 0; i < HANDLER_BATCH; i++) {
+    if (blk[i] != NULL) {
+      if (!check(blk[i], cookie + (uint64_t)i * 1024u)) {
+        __atomic_fetch_add(&corruptions, 1, __ATOMIC_RELAXED);
+      }
+      det_free(pool, blk[i]);
+    }
+  }
+  __atomic_fetch_add(&handler_runs, 1, __ATOMIC_RELAXED);
+}
+
+static void *worker(void *arg) {
+  void *blk[WORKER_BATCH];
+  uint64_t cookie = (uint64_t)(uintptr_t)arg << 40;
+  unsigned long rounds = 0;
+  int i;
+
+  while (running) {
+    for (i = 0; i < WORKER_BATCH; i++) {
+      blk[i] = det_alloc(pool);
+      if (blk[i] != NULL) {
+        stamp(blk[i], cookie + rounds * WORKER_BATCH + (uint64_t)i);
+      }
+    }
+    for (i = 0; i < WORKER_BATCH; i++) {
+      if (blk[i] != NULL) {
+        if (!check(blk[i], cookie + rounds * WORKER_BATCH + (uint64_t)i)) {
+          __atomic_fetch_add(&corruptions, 1, __ATOMIC_RELAXED);
+        }
+        det_free(pool, blk[i]);
+      }
+    }
+    rounds++;
+  }
+  return NULL;
+}
+
+static void *signaler(void *arg) {
+  unsigned long *sent = (unsigned long *)arg;
+  int i = 0;
+
+  while (running) {
+    if (pthread_kill(workers[i], SIGUSR1) == 0) {
+      (*sent)++;
+    }
+    i = (i + 1) % NUM_WORKERS;
+  }
+  return NULL;
+}
+
+static int drain_check(void) {
+  static void *all[NUM_BLOCKS];
+  size_t i;
+  size_t j;
+
+  for (i = 0; i < NUM_BLOCKS; i++) {
+    all[i] = det_alloc(pool);
+    if (all[i] == NULL) {
+      printf("  drain: only %zu of %d blocks recovered\n", i, NUM_BLOCKS);
+      return 0;
+    }
+    memset(all[i], 0, BLOCK_SIZE);
+    ((uint32_t *)all[i])[0] = (uint32_t)i + 1;
+  }
+  if (det_alloc(pool) != NULL) {
+    printf("  drain: pool handed out more than %d blocks\n", NUM_BLOCKS);
+    return 0;
+  }
+  for (i = 0; i < NUM_BLOCKS; i++) {
+    j = ((uint32_t *)all[i])[0];
+    if (j != i + 1) {
+      printf("  drain: block %zu handed out twice\n", i);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  det_config_t cfg = det_default_config();
+  struct sigaction sa;
+  struct itimerval timer;
+  struct timespec dur;
+  pthread_t sig_thread;
+  unsigned long sent = 0;
+  int seconds = argc > 1 ? atoi(argv[1]) : 2;
+  int ok;
+  int i;
+
+  cfg.block_size = BLOCK_SIZE;
+  cfg.num_blocks = NUM_BLOCKS;
+  cfg.signal_safe = true;
+  if (det_alloc_size(&cfg) > sizeof(arena)) {
+    fprintf(stderr, "arena too small: need %zu\n", det_alloc_size(&cfg));
+    return 1;
+  }
+  pool = det_alloc_init(arena, sizeof(arena), &cfg);
+  if (pool == NULL) {
+    fprintf(stderr, "det_alloc_init failed\n");
+    return 1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, NULL);
+  sigaction(SIGALRM, &sa, NULL);
+
+  for (i = 0; i < NUM_WORKERS; i++) {
+    pthread_create(&workers[i], NULL, worker, (void *)(uintptr_t)(i + 1));
+  }
+  pthread_create(&sig_thread, NULL, signaler, &sent);
+
+  memset(&timer, 0, sizeof(timer));
+  timer.it_interval.tv_usec = 50;
+  timer.it_value.tv_usec = 50;
+  setitimer(ITIMER_REAL, &timer, NULL);
+
+  dur.tv_sec = seconds;
+  dur.tv_nsec = 0;
+  while (nanosleep(&dur, &dur) != 0) {
+  }
+
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_REAL, &timer, NULL);
+  running = 0;
+  pthread_join(sig_thread, NULL);
+  for (i = 0; i < NUM_WORKERS; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  printf("=== Signal Storm (%d s, %d workers, %d blocks) ===\n", seconds,
+         NUM_WORKERS, NUM_BLOCKS);
+  printf("  signals sent:     %lu (+ SIGALRM every 50 us)\n", sent);
+  printf("  handler runs:     %lu\n", handler_runs);
+  printf("  handler misses:   %lu (pool momentarily empty)\n", handler_misses);
+  printf("  corruptions:      %lu\n", corruptions);
+
+  ok = corruptions == 0 && drain_check();
+  printf("  result:           %s\n", ok ? "PASS" : "FAIL");
+  det_alloc_destroy(pool);
+  return ok ? 0 : 1;
+}
@@ -1,10 +1,10 @@
 /**
  * @file detalloc.h
- * @brief Detalloc — Phase 1: Single-Pool, Constant-Time Allocator
+ * @brief Detalloc — Deterministic Size-Class Pool Allocator
  *
- * Minimal API for a fixed-size, bitmap-based pool allocator with O(1)
- * alloc/free. Designed for hard real-time use; no syscalls after init; uses
- * user-provided memory.
+ * Fixed-size, bitmap-based pools with O(1) alloc/free, grouped into size
+ * classes with bounded spill. Designed for hard real-time use; no syscalls
+ * after init on the allocation path; uses user-provided memory.
  *
  * @version 0.1.0
  * @date 2025
@@ -65,7 +65,7 @@ extern "C" {
 /* ========================================================================== */
 /* Defaults & Align                                                           */
 /* ========================================================================== */
-/** Default block size for Phase 1 (can be overridden at init-time). */
+/** Default block size (can be overridden at init-time). */
 #ifndef DET_DEFAULT_BLOCK_SIZE
 #define DET_DEFAULT_BLOCK_SIZE 64
 #endif
@@ -75,6 +75,31 @@ extern "C" {
 #define DET_DEFAULT_ALIGN 8
 #endif
 
+/** Maximum number of size classes per allocator (library build setting). */
+#ifndef DET_MAX_CLASSES
+#define DET_MAX_CLASSES 16
+#endif
+
+/** log2 buckets of the per-class lifetime histogram (library build setting). */
+#ifndef DET_LIFETIME_BUCKETS
+#define DET_LIFETIME_BUCKETS 48
+#endif
+
+/** log2 buckets of the per-class latency histograms (library build setting). */
+#ifndef DET_LATENCY_BUCKETS
+#define DET_LATENCY_BUCKETS 24
+#endif
+
+/** Granule in which reserved pools are committed (library build setting). */
+#ifndef DET_COMMIT_CHUNK
+#define DET_COMMIT_CHUNK (2u * 1024u * 1024u)
+#endif
+
+/** Bytes kept of config.tenant, including the terminating NUL. */
+#ifndef DET_TENANT_MAX
+#define DET_TENANT_MAX 32
+#endif
+
 /** Align up helper. */
 #ifndef DET_ALIGN_UP
 #define DET_ALIGN_UP(sz, a) (((sz) + ((a)-1)) & ~((a)-1))
@@ -87,46 +112,124 @@ extern "C" {
  * @brief Error/status codes returned by Detalloc.
  */
 typedef enum {
-  DET_OK = 0,             /**< Operation successful */
-  DET_ERR_INVALID_PARAM,  /**< A parameter is invalid */
-  DET_ERR_OUT_OF_MEMORY,  /**< Buffer cannot accommodate configuration */
-  DET_ERR_POOL_FULL,      /**< Pool has no free blocks */
-  DET_ERR_INVALID_PTR,    /**< Pointer not owned by allocator/pool */
-  DET_ERR_NOT_INITIALIZED /**< Allocator not initialized */
+  DET_OK = 0,              /**< Operation successful */
+  DET_ERR_INVALID_PARAM,   /**< A parameter is invalid */
+  DET_ERR_OUT_OF_MEMORY,   /**< Buffer cannot accommodate configuration */
+  DET_ERR_POOL_FULL,       /**< Pool has no free blocks */
+  DET_ERR_INVALID_PTR,     /**< Pointer not owned by allocator/pool */
+  DET_ERR_NOT_INITIALIZED, /**< Allocator not initialized */
+  DET_ERR_BUSY             /**< Concurrent update in progress, retry */
 } det_error_t;
 
 /* ========================================================================== */
 /* Opaque Handle                                                              */
 /* ========================================================================== */
 /**
- * @brief Opaque allocator handle (single pool in Phase 1).
+ * @brief Opaque allocator handle: one pool per size class (and shard).
  *
  * Implementation maintains:
  *  - user buffer base/limit
  *  - bitmap for free/used slots
- *  - fixed block size & count
+ *  - fixed block size & count per pool
  *  - optional lock if thread_safe=true
+ *  - lock-free free list if signal_safe=true
  */
 typedef struct det_allocator det_allocator_t;
 
 /* ========================================================================== */
-/* Configuration (Phase 1)                                                    */
+/* Configuration                                                              */
 /* ========================================================================== */
 /**
- * @brief Phase-1 configuration: one fixed-size pool.
+ * @brief Expected lifetime of an allocation; see det_alloc_hint().
+ */
+typedef enum {
+  DET_LIFETIME_ANY = 0, /**< Unhinted (det_alloc_sized()), default tag */
+  DET_LIFETIME_SHORT,   /**< Freed soon, e.g. per request or message */
+  DET_LIFETIME_LONG,    /**< Lives for a session or the whole run */
+  DET_LIFETIME_FRAME    /**< Never freed; dies at the next det_frame_reset() */
+} det_lifetime_t;
+
+/**
+ * @brief One size class of a multi-class configuration.
+ */
+typedef struct {
+  size_t block_size;       /**< Block size of this class in bytes. */
+  size_t num_blocks;       /**< Number of blocks in this class. */
+  det_lifetime_t lifetime; /**< Lifetime group (not FRAME), default ANY. */
+  /** Block alignment (power of two), 0 = config align. Tiny classes
+   *  ignore config align: they are packed at their power-of-two size
+   *  unless this is larger. */
+  size_t align;
+} det_class_config_t;
+
+/**
+ * @brief Allocator configuration; start from det_default_config().
+ *
+ * Options marked "not with" are rejected by det_alloc_size() and
+ * det_alloc_init() in that combination.
  */
 typedef struct {
   size_t block_size; /**< Size of each block in bytes (e.g., 64). */
   size_t num_blocks; /**< Number of blocks in the pool. */
-  size_t align; /**< Alignment for allocations (default DET_DEFAULT_ALIGN). */
+  /** Block alignment (power of two, default DET_DEFAULT_ALIGN). Blocks are
+   *  at least as large and aligned as their free-list link: 2 bytes in
+   *  pools of up to 65535 blocks, 4 up to UINT32_MAX, else sizeof(size_t). */
+  size_t align;
   bool thread_safe; /**< Optional: enable internal locking (constant-time). */
+  /** Optional: lock-free, async-signal-safe alloc/free; implies
+   *  thread_safe, needs lock-free 64-bit atomics, at most UINT32_MAX - 1
+   *  blocks per pool, no tiny classes. The only thread-safe mode of
+   *  RT_ALLOC_FREESTANDING builds. */
+  bool signal_safe;
+  uint8_t high_watermark; /**< Optional: high occupancy % (0 = disabled). */
+  uint8_t low_watermark;  /**< Optional: re-arm occupancy % (< high). */
+  /** Optional: size classes replacing block_size / num_blocks, ascending
+   *  within each lifetime group (det_alloc_sized(), det_alloc_hint()).
+   *  Classes of at most half a pointer are tiny: bitmap-only, no links. */
+  const det_class_config_t *classes;
+  size_t num_classes; /**< Entries in @c classes (1..DET_MAX_CLASSES). */
+  /** Larger classes of the same lifetime group tried when a class is full;
+   *  clamped to the classes available. */
+  size_t max_spill;
+  /** Optional: per-class alloc-to-free histograms (RT_ALLOC_LIFETIME
+   *  builds); 8 bytes and one det_get_cycles() per block. */
+  bool track_lifetime;
+  /** Optional: bump region for DET_LIFETIME_FRAME requests, emptied by
+   *  det_frame_reset() (0 = none). */
+  size_t frame_size;
+  /** Optional: owner label for exported stats, copied at init and cut to
+   *  DET_TENANT_MAX - 1 bytes. */
+  const char *tenant;
+  /** Optional: handle table slots for det_handle_alloc() and det_compact()
+   *  (0 = none); not with signal_safe. */
+  size_t num_handles;
+  /** Optional: the buffer is reserved PROT_NONE address space; payloads are
+   *  committed in DET_COMMIT_CHUNK pieces by det_commit_ahead(). */
+  bool reserved;
+  /** Optional: with @c reserved, det_alloc() may commit the chunk it
+   *  reaches (one mprotect()) instead of failing. */
+  bool commit_inline;
+  /** Optional: boundary each class's payload starts on, a power of two
+   *  such as 4096 or 2 MiB (0 = cache line). */
+  size_t payload_align;
+  /** Optional: store free-list links XOR-ed with a per-pool secret; bad
+   *  links are dropped and counted in link_faults in every mode. */
+  bool safe_linking;
+  /** Optional: end every block of a page or more at a PROT_NONE page.
+   *  Ignored in NDEBUG builds; not with @c reserved. */
+  bool guard_pages;
+  /** Optional: lock stripes per class, a power of two (0 or 1 = off);
+   *  thread_safe only, not with handles, classes x shards at most
+   *  DET_MAX_CLASSES. Each shard is reported as a pool. */
+  size_t shards;
+  size_t shard_probes; /**< Other shards tried when home is full (0 = all). */
 } det_config_t;
 
 /* ========================================================================== */
 /* Core API                                                                   */
 /* ========================================================================== */
 /**
- * @brief Compute required buffer size for a given Phase-1 config.
+ * @brief Compute required buffer size for a given config.
  *
  * Calculates metadata + bitmap + aligned payload area.
  *
@@ -145,7 +248,7 @@ DETALLOC_API size_t det_alloc_size(const det_config_t *config);
  *
  * @param memory Pointer to pre-allocated memory buffer (non-NULL)
  * @param size   Size of memory buffer in bytes (>= det_alloc_size(config))
- * @param config Non-NULL Phase-1 configuration
+ * @param config Non-NULL configuration
  * @return Allocator handle on success, or NULL on error
  *
  * @note The buffer must remain valid for the allocator lifetime.
@@ -158,15 +261,71 @@ DETALLOC_API det_allocator_t *det_alloc_init(void *memory, size_t size,
 /**
  * @brief Allocate a single fixed-size block.
  *
+ * In a multi-class configuration this allocates from the smallest class.
+ *
  * @param alloc Allocator handle
  * @return Pointer to block on success, or NULL if pool is full
  *
  * @note Returned pointer is aligned to config.align.
+ * @note Async-signal-safe and reentrant when config.signal_safe is set.
  * @par Complexity
- * O(1) worst-case.
+ * O(1) worst-case; with signal_safe, lock-free (a CAS retries only when
+ * another thread or a signal handler changed the pool in between).
  */
 DETALLOC_API void *det_alloc(det_allocator_t *alloc);
 
+/**
+ * @brief Allocate a block of at least @p size bytes.
+ *
+ * Picks the smallest class whose block_size fits @p size and spills to at
+ * most config.max_spill larger classes if it is exhausted. With a single
+ * pool this is det_alloc() plus a size check.
+ *
+ * @param alloc Allocator handle
+ * @param size  Requested size in bytes
+ * @return Pointer to block, or NULL if no class fits or all tried are full
+ *
+ * @par Complexity
+ * O(DET_MAX_CLASSES) worst-case, independent of pool sizes.
+ */
+DETALLOC_API void *det_alloc_sized(det_allocator_t *alloc, size_t size);
+
+/**
+ * @brief Allocate @p size bytes from the pools reserved for @p lifetime.
+ *
+ * Works like det_alloc_sized() restricted to the classes tagged
+ * @p lifetime, so objects that die together share pages and long-lived
+ * objects do not pin pages full of short-lived holes. A tag without classes
+ * of its own falls back to the ANY classes, then to the LONG or SHORT ones.
+ *
+ * DET_LIFETIME_FRAME requests are carved from the frame region and must not
+ * be passed to det_free() (it ignores them); they all die at the next
+ * det_frame_reset(). Without a frame region they are served as SHORT.
+ *
+ * @param alloc    Allocator handle
+ * @param size     Requested size in bytes
+ * @param lifetime Expected lifetime
+ * @return Pointer to at least @p size bytes aligned like its class, or NULL
+ *
+ * @par Complexity
+ * O(DET_MAX_CLASSES) worst-case; O(1) for the frame region.
+ */
+DETALLOC_API void *det_alloc_hint(det_allocator_t *alloc, size_t size,
+                                  det_lifetime_t lifetime);
+
+/**
+ * @brief Release every DET_LIFETIME_FRAME allocation at once.
+ *
+ * Typically called at the end of a frame or cycle. The caller guarantees
+ * that no frame allocation is still in use, including by other threads.
+ *
+ * @param alloc Allocator handle
+ *
+ * @par Complexity
+ * O(1).
+ */
+DETALLOC_API void det_frame_reset(det_allocator_t *alloc);
+
 /**
  * @brief Allocate a zero-initialized block.
  *
@@ -178,15 +337,44 @@ DETALLOC_API void *det_alloc(det_allocator_t *alloc);
  */
 DETALLOC_API void *det_calloc(det_allocator_t *alloc);
 
+/**
+ * @brief Allocate like det_alloc(), blocking up to @p timeout_ns while the
+ * pool is full.
+ *
+ * Meant for producer stages that would otherwise spin-retry det_alloc():
+ * the caller sleeps on a futex word in the pool's metadata and the next
+ * det_free() to that pool wakes one waiter. Frees check for waiters with a
+ * single load, so det_alloc() and det_free() stay constant-time when
+ * nobody waits. Watermarks do not affect waking.
+ *
+ * Waiting needs config.thread_safe or config.signal_safe (in plain mode no
+ * other thread may free) and Linux futexes; otherwise, and for a
+ * @p timeout_ns of 0, this is det_alloc(). Other pools' frees do not wake
+ * the caller, including blocks of the larger classes it may spill to.
+ *
+ * @param alloc      Allocator handle
+ * @param timeout_ns Longest wait in nanoseconds; UINT64_MAX waits forever
+ * @return Pointer to block, or NULL if the pool stayed full until timeout
+ *
+ * @warning Not async-signal-safe and not for hard real-time threads: it may
+ * sleep. det_free() from a signal handler may still wake a waiter.
+ * @par Complexity
+ * Unbounded (waits for another thread); O(1) per attempt.
+ */
+DETALLOC_API void *det_alloc_wait(det_allocator_t *alloc, uint64_t timeout_ns);
+
 /**
  * @brief Free a previously allocated block (NULL is a no-op).
  *
+ * The block returns to the class it was allocated from, found by address.
+ *
  * @param alloc Allocator handle
  * @param ptr   Pointer returned by det_alloc()/det_calloc()
  *
  * @warning Undefined behavior if @p ptr was not allocated by this allocator.
+ * @note Async-signal-safe and reentrant when config.signal_safe is set.
  * @par Complexity
- * O(1) worst-case.
+ * O(1) worst-case; lock-free with signal_safe (see det_alloc()).
  */
 DETALLOC_API void det_free(det_allocator_t *alloc, void *ptr);
 
@@ -195,7 +383,7 @@ DETALLOC_API void det_free(det_allocator_t *alloc, void *ptr);
  *
  * @param alloc Allocator handle
  * @param ptr   Pointer to allocated block
- * @return Fixed block size (or 0 if invalid)
+ * @return Block size of the owning class (or 0 if invalid)
  *
  * @par Complexity
  * O(1).
@@ -210,21 +398,860 @@ DETALLOC_API size_t det_alloc_usable_size(det_allocator_t *alloc, void *ptr);
  * @param alloc Allocator handle
  *
  * @par Complexity
- * O(1).
+ * O(1); O(guarded blocks) with config.guard_pages in debug builds.
  */
 DETALLOC_API void det_alloc_destroy(det_allocator_t *alloc);
 
+/* ========================================================================== */
+/* Occupancy Watermarks                                                       */
+/* ========================================================================== */
+/**
+ * @brief Watermark edge events reported by det_watermark_poll().
+ */
+typedef enum {
+  DET_WM_NONE = 0,     /**< No edge since the last poll */
+  DET_WM_HIGH = 1 << 0, /**< Occupancy rose to the high watermark */
+  DET_WM_LOW = 1 << 1   /**< Occupancy fell back to the low watermark */
+} det_watermark_event_t;
+
+/**
+ * @brief Watermark notification callback.
+ *
+ * @param alloc  Allocator whose pool crossed a watermark
+ * @param pool   Index of that pool (size class)
+ * @param events Bitwise OR of det_watermark_event_t edges since last poll
+ * @param user   Opaque pointer passed to det_watermark_poll()
+ */
+typedef void (*det_watermark_fn)(det_allocator_t *alloc, size_t pool,
+                                 unsigned events, void *user);
+
+/**
+ * @brief Whether any pool is above its high watermark.
+ *
+ * A pool is above once its occupancy reaches config.high_watermark percent
+ * of its blocks, and until it falls back to config.low_watermark percent
+ * (hysteresis), so admission control can throttle before det_alloc() starts
+ * failing. Per-pool levels are in det_pool_stats_t.
+ *
+ * @param alloc Allocator handle
+ * @return true while at least one pool is above
+ *
+ * @par Complexity
+ * O(1), a single load; safe on the hot path.
+ */
+DETALLOC_API bool det_watermark_above(const det_allocator_t *alloc);
+
+/**
+ * @brief Collect and deliver pending watermark edges.
+ *
+ * det_alloc()/det_free() only record edges (one compare per call, one atomic
+ * OR per crossing). Call this from a non-RT context, e.g. a monitor thread;
+ * the callback may do anything, including writing an eventfd.
+ *
+ * @param alloc Allocator handle
+ * @param fn    Callback invoked per pool with pending edges (may be NULL)
+ * @param user  Opaque pointer forwarded to @p fn
+ * @return OR of pending det_watermark_event_t bits (cleared by this call)
+ *
+ * @par Complexity
+ * O(pools) plus the callbacks.
+ */
+DETALLOC_API unsigned det_watermark_poll(det_allocator_t *alloc,
+                                         det_watermark_fn fn, void *user);
+
+/* ========================================================================== */
+/* Handles and Compaction                                                     */
+/* ========================================================================== */
+/**
+ * @brief Relocatable allocation: generation (high 32 bits) and slot + 1.
+ */
+typedef uint64_t det_handle_t;
+
+/** The invalid handle; det_handle_alloc() returns it on failure. */
+#define DET_HANDLE_NULL ((det_handle_t)0)
+
+/**
+ * @brief Allocate @p size bytes reached through a handle.
+ *
+ * Routed like det_alloc_hint(DET_LIFETIME_LONG): handles are meant for
+ * long-lived objects, which det_compact() may later move into denser pages.
+ *
+ * @param alloc Allocator with config.num_handles != 0
+ * @param size  Requested size in bytes
+ * @return Handle, or DET_HANDLE_NULL if no block or no slot is free
+ *
+ * @par Complexity
+ * O(DET_MAX_CLASSES) worst-case, like det_alloc_sized().
+ */
+DETALLOC_API det_handle_t det_handle_alloc(det_allocator_t *alloc,
+                                           size_t size);
+
+/**
+ * @brief Free a handle and its block; stale handles are ignored.
+ *
+ * Handle blocks must be released here, never with det_free().
+ *
+ * @par Complexity
+ * O(1).
+ */
+DETALLOC_API void det_handle_free(det_allocator_t *alloc, det_handle_t h);
+
+/**
+ * @brief Current address of a handle's block.
+ *
+ * Valid until the next det_compact(); use det_handle_pin() or
+ * det_handle_read() when compaction runs concurrently.
+ *
+ * @return Block address, or NULL for a stale or invalid handle
+ */
+DETALLOC_API void *det_handle_get(det_allocator_t *alloc, det_handle_t h);
+
+/**
+ * @brief Resolve a handle and keep det_compact() from moving its block.
+ *
+ * Waits while the block is being moved (one block copy at most). Every pin
+ * must be paired with det_handle_unpin().
+ *
+ * @return Block address, or NULL for a stale or invalid handle
+ *
+ * @par Complexity
+ * O(1) plus at most one concurrent block copy.
+ */
+DETALLOC_API void *det_handle_pin(det_allocator_t *alloc, det_handle_t h);
+
+/**
+ * @brief Drop a pin taken with det_handle_pin().
+ */
+DETALLOC_API void det_handle_unpin(det_allocator_t *alloc, det_handle_t h);
+
+/**
+ * @brief Copy the first @p len bytes of a handle's block without pinning.
+ *
+ * Each handle carries a sequence count that det_compact() makes odd while it
+ * moves the block; the copy is retried when it overlapped a move.
+ *
+ * @param alloc Allocator handle
+ * @param h     Handle
+ * @param dst   Destination buffer
+ * @param len   Bytes to copy (at most the block size)
+ * @return DET_OK, DET_ERR_INVALID_PARAM for a stale handle or a too large
+ *         @p len, or DET_ERR_BUSY if every bounded retry overlapped a move
+ */
+DETALLOC_API det_error_t det_handle_read(det_allocator_t *alloc,
+                                         det_handle_t h, void *dst,
+                                         size_t len);
+
+/**
+ * @brief Move handle blocks from the top of their pools into lower holes.
+ *
+ * Non-RT. Works pool by pool: it first rebuilds the free list in address
+ * order, so holes in dense pages are reused first, then moves the highest
+ * unpinned handle blocks into the lowest holes, and finally lowers the
+ * pool's high-water index below the freed tail so det_trim() can release
+ * it. Blocks allocated without a handle never move and stay where they are.
+ *
+ * The lock is taken per unit of work and dropped in between. A move holds
+ * it for one block copy; a rebuild step scans 8 bitmap words and links at
+ * most the 512 blocks they cover.
+ *
+ * A pass may be left after DET_ERR_BUSY, but should be driven to DET_OK:
+ * blocks moved away from stay allocatable, while in a pool whose rebuild
+ * is under way the holes below the scan position are reused only through
+ * the old free list, and blocks freed there only once the pass resumes.
+ *
+ * @param alloc  Allocator with config.num_handles != 0, not signal_safe;
+ *               without thread_safe, call from the allocating thread
+ * @param budget Units of work (one move or one rebuild step each) for this
+ *               call
+ * @return DET_OK once every pool is compacted (the next call starts over),
+ *         DET_ERR_BUSY if work remains, DET_ERR_INVALID_PARAM otherwise
+ */
+DETALLOC_API det_error_t det_compact(det_allocator_t *alloc, size_t budget);
+
+/**
+ * @brief Commit reserved pool memory ahead of the bump index.
+ *
+ * Non-RT. For a config.reserved allocator, makes sure at least @p n blocks
+ * past each pool's bump index (or the rest of the pool) are committed,
+ * rounding up to DET_COMMIT_CHUNK, so later det_alloc() calls stay
+ * syscall-free. Call it after det_alloc_init() and from a housekeeping
+ * thread as pools fill. A no-op for other allocators.
+ *
+ * @param alloc Allocator
+ * @param n     Blocks of headroom wanted per pool
+ * @return DET_OK, or DET_ERR_OUT_OF_MEMORY if mprotect() failed for a pool
+ */
+DETALLOC_API det_error_t det_commit_ahead(det_allocator_t *alloc, size_t n);
+
+/**
+ * @brief Return the never-used tail of every pool to the OS.
+ *
+ * Pages past each pool's high-water index hold no data and are released
+ * with madvise(MADV_DONTNEED); they fault back in, zeroed, when reused.
+ * In a reserved allocator whole DET_COMMIT_CHUNK chunks are released and
+ * made PROT_NONE again, to be recommitted by det_commit_ahead().
+ * Non-RT (a system call per pool, under the lock in thread_safe mode).
+ *
+ * @param alloc Allocator, not signal_safe; buffer must be anonymous memory
+ * @return Bytes released (0 where madvise is unavailable, always 0 in
+ *         RT_ALLOC_FREESTANDING builds)
+ */
+DETALLOC_API size_t det_trim(det_allocator_t *alloc);
+
+/* ========================================================================== */
+/* Migration                                                                  */
+/* ========================================================================== */
+/**
+ * @brief Move a live allocator into a larger buffer.
+ *
+ * Non-RT; call it at a quiescent point (no concurrent calls on @p alloc, no
+ * pinned handles). @p new_cfg must describe the same classes (block sizes
+ * and lifetimes) with at least as many blocks each, and enough handles and
+ * frame bytes for what is in use; other settings may change. Every live
+ * block keeps its pool and index, so handles stay valid and block indices
+ * stay meaningful. Only blocks below each pool's bump index are visited, and
+ * live ones are copied with non-temporal stores where available, so the
+ * pause follows the data in use rather than the arena sizes.
+ *
+ * @p alloc is left untouched: raw pointers into it can still be translated
+ * with det_alloc_relocate() before its memory is released.
+ *
+ * @param alloc    Allocator to migrate
+ * @param new_mem  New buffer, not overlapping the old one
+ * @param new_size Size of @p new_mem (see det_alloc_size())
+ * @param new_cfg  Configuration of the new allocator
+ * @return The new allocator, or NULL if @p new_cfg cannot hold the contents
+ *         (@p new_mem is then torn down like det_alloc_destroy() does)
+ */
+DETALLOC_API det_allocator_t *det_alloc_migrate(det_allocator_t *alloc,
+                                                void *new_mem,
+                                                size_t new_size,
+                                                const det_config_t *new_cfg);
+
+/**
+ * @brief Translate a pointer into @p from to its place after migration.
+ *
+ * Works for block and interior pointers and for the frame region. O(classes).
+ *
+ * @return The matching address in @p to, or NULL if @p ptr is not in @p from
+ */
+DETALLOC_API void *det_alloc_relocate(const det_allocator_t *from,
+                                      const det_allocator_t *to,
+                                      const void *ptr);
+
+/* ========================================================================== */
+/* Real-Time Readiness                                                        */
+/* ========================================================================== */
+/**
+ * @brief Steps taken by det_rt_prepare().
+ */
+typedef enum {
+  DET_RT_LOCK_ARENA = 0x1,    /**< mlock() the arena's accessible pages */
+  DET_RT_LOCK_CODE = 0x2,     /**< mlock() the object holding detalloc */
+  DET_RT_PREFAULT = 0x4,      /**< Write-touch every accessible arena page */
+  DET_RT_CHECK_BINDING = 0x8, /**< Look for lazily bound PLT calls */
+  DET_RT_ALL = 0xF            /**< Everything above */
+} det_rt_flags_t;
+
+/**
+ * @brief What det_rt_prepare() could not rule out; 0 means none found.
+ */
+typedef enum {
+  /** mlock() of the arena failed, usually RLIMIT_MEMLOCK */
+  DET_RT_RISK_ARENA_UNLOCKED = 0x1,
+  /** mlock() of the library's segments failed or they were not found */
+  DET_RT_RISK_CODE_UNLOCKED = 0x2,
+  /** The program or the library resolves PLT calls on first use */
+  DET_RT_RISK_LAZY_BINDING = 0x4,
+  /** Reserved pools are not fully committed: det_alloc() may fail early or,
+   *  with commit_inline, call mprotect() */
+  DET_RT_RISK_UNCOMMITTED = 0x8,
+  /** A requested step is not available on this platform */
+  DET_RT_RISK_UNSUPPORTED = 0x10
+} det_rt_risk_t;
+
+/**
+ * @brief Remove the page faults and dynamic-linker work left after init.
+ *
+ * Non-RT; call it once after det_alloc_init() (and after each
+ * det_commit_ahead() on a reserved arena), before the first real-time
+ * cycle. det_alloc_init() itself touches only O(classes) metadata, so
+ * without this the first use of each arena page costs a page fault, and the
+ * first call to each det_* function from a lazily bound program costs a
+ * trip through the dynamic linker.
+ *
+ * - DET_RT_LOCK_ARENA locks every page the allocator can touch: metadata,
+ *   pool payloads (only the committed part of a reserved pool; guard pages
+ *   are skipped) and the frame region.
+ * - DET_RT_LOCK_CODE locks the loaded segments of the object holding
+ *   detalloc: libdetalloc.so, or the program when linked statically.
+ * - DET_RT_PREFAULT writes every one of those pages (an atomic no-op, safe
+ *   against concurrent use), so they are present and private even where
+ *   mlock() is not allowed.
+ * - DET_RT_CHECK_BINDING inspects the dynamic sections of the program and
+ *   of the library: both must be linked with -z now, or LD_BIND_NOW must be
+ *   set, unless they have no PLT relocations.
+ *
+ * RT threads may keep running: a pool's lock is held only to read how much
+ * of it is committed, never across mlock() or the prefault. A concurrent
+ * det_trim() could decommit pages being touched, so do not overlap them.
+ *
+ * Memory locked here stays locked until the process unlocks or unmaps it.
+ * Thread stacks and the rest of the program are not covered; use
+ * mlockall(MCL_CURRENT | MCL_FUTURE) for those.
+ *
+ * @param alloc Allocator
+ * @param flags det_rt_flags_t bits
+ * @param risks Receives det_rt_risk_t bits for what is still exposed; may
+ *              be NULL
+ * @return DET_OK (even if risks remain), DET_ERR_INVALID_PARAM or
+ *         DET_ERR_NOT_INITIALIZED
+ */
+DETALLOC_API det_error_t det_rt_prepare(det_allocator_t *alloc,
+                                        unsigned flags, unsigned *risks);
+
+/* ========================================================================== */
+/* Statistics                                                                 */
+/* ========================================================================== */
+/**
+ * @brief Per-pool (size class) statistics.
+ *
+ * Counters are maintained when the library is built with RT_ALLOC_STATS
+ * (and without RT_ALLOC_NO_STATS); otherwise they read as zero. Geometry and
+ * occupancy are always valid. The WCET fields and latency histograms need
+ * RT_ALLOC_WCET, which adds two det_get_cycles() reads per call.
+ */
+typedef struct {
+  size_t block_size;    /**< Block size of this class */
+  size_t num_blocks;    /**< Capacity in blocks */
+  /** Lifetime group of this class */
+  det_lifetime_t lifetime;
+  size_t in_use;        /**< Blocks currently allocated */
+  size_t peak_in_use;   /**< Highest in_use observed */
+  uint64_t allocs;      /**< Blocks handed out by this pool */
+  uint64_t frees;       /**< Blocks returned to this pool */
+  uint64_t failures;    /**< Requests for this class that got NULL */
+  uint64_t spilled_out; /**< Requests for this class served by a larger one */
+  uint64_t spilled_in;  /**< Blocks handed out here for a smaller class */
+  uint64_t link_faults; /**< Bad free-list links dropped (always counted) */
+  bool above_watermark; /**< Between a high and the next low crossing */
+  /** Frees whose alloc-to-free time was in [2^i, 2^(i+1)) det_get_cycles()
+   *  ticks (bin 0 also holds 0 and 1, the last bin everything above). */
+  uint64_t lifetime_hist[DET_LIFETIME_BUCKETS];
+  uint64_t alloc_wcet; /**< Slowest allocation for this class, in cycles */
+  uint64_t free_wcet;  /**< Slowest det_free() into this class, in cycles */
+  /** Allocations for this class that took [2^i, 2^(i+1)) cycles, lock wait
+   *  included (binned like lifetime_hist). */
+  uint64_t alloc_latency_hist[DET_LATENCY_BUCKETS];
+  /** Same for det_free() calls returning a block to this class. */
+  uint64_t free_latency_hist[DET_LATENCY_BUCKETS];
+} det_pool_stats_t;
+
+/**
+ * @brief Allocator-wide statistics snapshot.
+ */
+typedef struct {
+  size_t num_pools;        /**< Valid entries in pool_stats */
+  size_t total_memory;     /**< Sum of block_size * num_blocks */
+  size_t used_memory;      /**< Sum of block_size * in_use */
+  uint64_t spilled;        /**< Allocations served by a larger class */
+  size_t frame_size;       /**< Frame region capacity in bytes */
+  size_t frame_used;       /**< Bytes handed out since the last reset */
+  size_t frame_peak;       /**< Highest frame_used observed */
+  uint64_t frame_failures; /**< Frame requests that did not fit */
+  char tenant[DET_TENANT_MAX]; /**< config.tenant, "" if unset */
+  det_pool_stats_t pool_stats[DET_MAX_CLASSES]; /**< Per size class */
+} det_stats_t;
+
+/**
+ * @brief Take a statistics snapshot.
+ *
+ * Reads counters with relaxed loads and never takes the allocator lock, so
+ * it may run concurrently with RT threads; fields may be mutually skewed by
+ * in-flight operations.
+ *
+ * @param alloc Allocator handle
+ * @param stats Output snapshot
+ * @return DET_OK, DET_ERR_INVALID_PARAM or DET_ERR_NOT_INITIALIZED
+ *
+ * @par Complexity
+ * O(pools).
+ */
+DETALLOC_API det_error_t det_get_stats(const det_allocator_t *alloc,
+                                       det_stats_t *stats);
+
+/**
+ * @brief Render statistics in the OpenMetrics (Prometheus) text format.
+ *
+ * Emits every pool counter and gauge, the latency and lifetime histograms
+ * with cumulative le buckets (in cycles), and the frame region, each sample
+ * labelled with pool, block_size, lifetime and, if set, tenant. The output
+ * ends with "# EOF" and a NUL. Nothing is allocated and no I/O is done, so
+ * any exporter can serve the buffer; formatting is hand-rolled.
+ *
+ * @param alloc Allocator handle
+ * @param buf   Output buffer
+ * @param len   Size of @p buf; allow about 16 KiB per pool
+ * @return Bytes written excluding the NUL, or 0 on error or if @p buf is too
+ *         small (never a truncated document)
+ *
+ * @par Complexity
+ * O(pools * buckets); not for RT threads (takes a det_get_stats() snapshot
+ * on the stack).
+ */
+DETALLOC_API size_t det_stats_format_openmetrics(const det_allocator_t *alloc,
+                                                 char *buf, size_t len);
+
+/* ========================================================================== */
+/* Shared-Memory Statistics                                                   */
+/* ========================================================================== */
+/** Identifies an initialized det_shm_stats_t ("DSHM"). */
+#define DET_SHM_MAGIC 0x4D485344u
+
+/** Layout version of det_shm_stats_t, bumped on incompatible changes. */
+#define DET_SHM_VERSION 2u
+
+/**
+ * @brief Statistics page shared with out-of-process monitors.
+ *
+ * Place it in a memfd or POSIX shm mapping. det_stats_publish() writes a
+ * det_get_stats() snapshot into it under a sequence lock, and det_shm_read()
+ * takes a consistent copy from any process that maps the same memory, such
+ * as the bundled detalloc-top. Both sides must agree on DET_MAX_CLASSES and
+ * the bucket counts; @c layout_size catches a mismatch.
+ */
+typedef struct {
+  uint32_t magic;       /**< DET_SHM_MAGIC once initialized */
+  uint32_t version;     /**< DET_SHM_VERSION */
+  uint32_t layout_size; /**< sizeof(det_shm_stats_t) of the writer */
+  uint32_t seq;         /**< Odd while a publish is in progress */
+  uint64_t publishes;   /**< Completed det_stats_publish() calls */
+  uint64_t cycles;      /**< det_get_cycles() at the last publish */
+  det_stats_t stats;    /**< Last published snapshot */
+} det_shm_stats_t;
+
+/**
+ * @brief Format a statistics page inside (shared) memory.
+ *
+ * @param memory Buffer of at least sizeof(det_shm_stats_t) bytes, aligned
+ *               to 8 (any mmap()ed region is)
+ * @param size   Size of @p memory
+ * @return The page, or NULL if @p memory is too small or misaligned
+ */
+DETALLOC_API det_shm_stats_t *det_shm_init(void *memory, size_t size);
+
+/**
+ * @brief Publish a statistics snapshot to @p page.
+ *
+ * Uses plain stores bracketed by two sequence updates: no syscalls, no
+ * locks and no atomic read-modify-writes, so an RT thread can call it at
+ * the end of every cycle. Only one thread may publish to a page at a time.
+ *
+ * @param alloc Allocator handle
+ * @param page  Page from det_shm_init()
+ * @return DET_OK, DET_ERR_INVALID_PARAM or DET_ERR_NOT_INITIALIZED
+ *
+ * @par Complexity
+ * O(pools), like det_get_stats().
+ */
+DETALLOC_API det_error_t det_stats_publish(const det_allocator_t *alloc,
+                                           det_shm_stats_t *page);
+
+/**
+ * @brief Copy a consistent snapshot out of a published page.
+ *
+ * Retries a bounded number of times while a publish is in progress.
+ *
+ * @param page Mapped page, possibly written by another process
+ * @param out  Output copy
+ * @return DET_OK; DET_ERR_INVALID_PARAM if @p page is not a compatible
+ *         page; DET_ERR_NOT_INITIALIZED if nothing was published yet;
+ *         DET_ERR_BUSY if every attempt raced with a publish
+ */
+DETALLOC_API det_error_t det_shm_read(const det_shm_stats_t *page,
+                                      det_shm_stats_t *out);
+
+/* ========================================================================== */
+/* Heap Dump                                                                  */
+/* ========================================================================== */
+/**
+ * @brief Output sink for det_dump(); returns false to abort the dump.
+ */
+typedef bool (*det_writer_fn)(void *user, const void *data, size_t len);
+
+/**
+ * @brief Heap dump formats.
+ */
+typedef enum {
+  DET_DUMP_JSON = 0, /**< Geometry, occupancy and per-page fill of all pools */
+  DET_DUMP_PGM,      /**< One pool's occupancy as a binary PGM image */
+  DET_DUMP_RLE       /**< One pool's occupancy as run lengths, text */
+} det_dump_format_t;
+
+/**
+ * @brief Resumable dump cursor; set up with det_dump_begin().
+ *
+ * Only @c page_size and @c width may be changed after det_dump_begin();
+ * the remaining fields are private progress state.
+ */
+typedef struct {
+  det_dump_format_t format; /**< Output format */
+  size_t pool;      /**< PGM/RLE: pool to render (JSON: all pools) */
+  size_t page_size; /**< JSON: fill-ratio granularity in bytes (4096) */
+  size_t width;     /**< PGM: image width in blocks (1024) */
+  unsigned stage;   /**< private */
+  size_t cls;       /**< private */
+  size_t pos;       /**< private */
+  size_t run;       /**< private */
+  bool run_used;    /**< private */
+  uintptr_t page;   /**< private */
+  size_t page_used; /**< private */
+  size_t page_all;  /**< private */
+} det_dump_t;
+
+/**
+ * @brief Prepare a dump cursor.
+ *
+ * @param dump   Cursor to initialize
+ * @param format Output format
+ * @param pool   Pool to render for DET_DUMP_PGM / DET_DUMP_RLE
+ */
+DETALLOC_API void det_dump_begin(det_dump_t *dump, det_dump_format_t format,
+                                 size_t pool);
+
+/**
+ * @brief Emit the next chunk of a dump, examining at most @p budget blocks.
+ *
+ * Occupancy is read with relaxed loads and no lock, so a dump of a live
+ * allocator never stalls RT threads; each chunk is a fresh look, so the
+ * whole image is only exact on a quiescent allocator.
+ *
+ * JSON: {"version", "tenant", "frame": {...}, "pools": [{"index",
+ * "block_size", "stride", "num_blocks", "lifetime", "in_use", "peak",
+ * "touched", "page_size", "pages": [fill percent per page]}]}.
+ * PGM: P5, @c width blocks per row, 255 = allocated, 0 = free, 128 = past
+ * the end. RLE: a "# detalloc-rle" header line, then alternating free and
+ * used run lengths, one per line, starting with free.
+ *
+ * @param alloc  Allocator handle
+ * @param dump   Cursor from det_dump_begin()
+ * @param budget Blocks to examine in this call (>= 1)
+ * @param writer Output sink, called with small pieces
+ * @param user   Forwarded to @p writer
+ * @return DET_OK when the dump is complete, DET_ERR_BUSY if more chunks
+ *         remain, DET_ERR_OUT_OF_MEMORY if @p writer refused data,
+ *         DET_ERR_INVALID_PARAM or DET_ERR_NOT_INITIALIZED
+ *
+ * @par Complexity
+ * O(budget) plus constant formatting work.
+ */
+DETALLOC_API det_error_t det_dump_step(const det_allocator_t *alloc,
+                                       det_dump_t *dump, size_t budget,
+                                       det_writer_fn writer, void *user);
+
+/**
+ * @brief Write the whole JSON heap map in one call.
+ *
+ * Equivalent to det_dump_step() with DET_DUMP_JSON until completion; for a
+ * large live allocator prefer stepping from a background thread.
+ *
+ * @return As det_dump_step(), never DET_ERR_BUSY
+ */
+DETALLOC_API det_error_t det_dump(const det_allocator_t *alloc,
+                                  det_writer_fn writer, void *user);
+
+/* ========================================================================== */
+/* Pipelined Frame Allocator                                                  */
+/* ========================================================================== */
+/** Maximum arenas of a det_frame_alloc_t (triple buffering). */
+#define DET_FRAME_MAX_ARENAS 3
+
+/**
+ * @brief Opaque frame allocator: 2-3 bump arenas rotated per frame.
+ *
+ * Frame N allocates from arena N % num_arenas while consumers still read
+ * frames N-1 (and N-2). det_frame_advance() starts the next frame and resets
+ * its arena in O(1), provided the frame that last used it was retired.
+ */
+typedef struct det_frame_alloc det_frame_alloc_t;
+
+/**
+ * @brief Frame allocator configuration.
+ */
+typedef struct {
+  size_t arena_size;   /**< Bytes per arena, i.e. per frame in flight */
+  unsigned num_arenas; /**< 2 (double) or 3 (triple buffering) */
+  size_t align;        /**< Alignment of allocations (power of two) */
+  size_t chunk_size;   /**< Bytes a cache grabs per refill (0: no caching) */
+} det_frame_config_t;
+
+/**
+ * @brief Per-thread chunk cache for det_frame_alloc().
+ *
+ * Owned by one thread (zero-initialize it, or use DET_FRAME_CACHE_INIT).
+ * Small allocations are bumped from the cached chunk without atomics; the
+ * shared arena is touched once per chunk.
+ */
+typedef struct {
+  uint8_t *cur;   /**< private */
+  uint8_t *end;   /**< private */
+  uint64_t frame; /**< private: frame + 1 the chunk belongs to, 0 = none */
+} det_frame_cache_t;
+
+/** Static initializer for det_frame_cache_t. */
+#define DET_FRAME_CACHE_INIT {NULL, NULL, 0}
+
+/**
+ * @brief Frame allocator statistics, for sizing arenas.
+ */
+typedef struct {
+  uint64_t frame;    /**< Current frame number */
+  uint64_t retired;  /**< Frames below this number are retired */
+  size_t arena_size; /**< Capacity of each arena */
+  size_t used;       /**< Bytes taken from the current arena so far */
+  size_t last_hwm;   /**< Bytes the previous frame ended with */
+  size_t max_hwm;    /**< Largest frame so far */
+  uint64_t failures; /**< Allocations that did not fit their frame */
+  uint64_t stalls;   /**< det_frame_advance() calls refused (not retired) */
+} det_frame_stats_t;
+
+/**
+ * @brief Defaults: 2 arenas, DET_DEFAULT_ALIGN, 4 KiB chunks, arena_size 0
+ *        (must be set).
+ */
+DETALLOC_API det_frame_config_t det_frame_default_config(void);
+
+/**
+ * @brief Bytes needed for a frame allocator (including alignment slack).
+ *
+ * @return Required bytes, or 0 if @p config is invalid
+ */
+DETALLOC_API size_t det_frame_alloc_size(const det_frame_config_t *config);
+
+/**
+ * @brief Build a frame allocator in @p memory; frame 0 is current.
+ *
+ * @return Handle, or NULL if @p config is invalid or @p size too small
+ */
+DETALLOC_API det_frame_alloc_t *
+det_frame_alloc_init(void *memory, size_t size,
+                     const det_frame_config_t *config);
+
+/**
+ * @brief Allocate @p size bytes in the current frame.
+ *
+ * Thread-safe; with a @p cache the common case is a local bump. Blocks are
+ * never freed individually: they stay valid until their frame is retired.
+ *
+ * @param fa    Frame allocator
+ * @param cache Calling thread's cache, or NULL to bump the arena directly
+ * @param size  Requested bytes
+ * @return Pointer aligned to config.align, or NULL if the frame is full
+ *
+ * @par Complexity
+ * O(1); one atomic add per chunk refill (or per call without a cache).
+ */
+DETALLOC_API void *det_frame_alloc(det_frame_alloc_t *fa,
+                                   det_frame_cache_t *cache, size_t size);
+
+/**
+ * @brief Start the next frame (one controlling thread only).
+ *
+ * Records the finished frame's high-water mark and resets the arena of the
+ * new frame in O(1). Producers must be done allocating for the old frame.
+ *
+ * @param fa    Frame allocator
+ * @param frame Optional: receives the new frame number
+ * @return DET_OK, or DET_ERR_BUSY if the frame that last used the arena has
+ *         not been retired yet (nothing changes; retry later)
+ */
+DETALLOC_API det_error_t det_frame_advance(det_frame_alloc_t *fa,
+                                           uint64_t *frame);
+
+/**
+ * @brief Mark frames up to and including @p frame as consumed.
+ *
+ * Called by the consumer stage; their arenas may then be reused.
+ *
+ * @par Complexity
+ * O(1).
+ */
+DETALLOC_API void det_frame_retire(det_frame_alloc_t *fa, uint64_t frame);
+
+/**
+ * @brief Snapshot frame allocator statistics (relaxed loads, no locks).
+ */
+DETALLOC_API det_error_t det_frame_get_stats(const det_frame_alloc_t *fa,
+                                             det_frame_stats_t *stats);
+
+/* ========================================================================== */
+/* Size-Class Calibration                                                     */
+/* ========================================================================== */
+/**
+ * @brief Opaque calibration handle (request-size profiler).
+ *
+ * During a warm-up window det_calib_alloc() serves requests from a fallback
+ * engine while recording a log-scale size histogram and per-size peak
+ * concurrency. det_freeze() then derives a class table and per-class block
+ * counts, builds a regular allocator in a fresh arena and switches over.
+ */
+typedef struct det_calib det_calib_t;
+
+/** Fallback engine used before det_freeze(): allocate @p size bytes. */
+typedef void *(*det_fallback_alloc_fn)(void *user, size_t size);
+
+/** Fallback engine used before det_freeze(): release @p ptr. */
+typedef void (*det_fallback_free_fn)(void *user, void *ptr);
+
+/**
+ * @brief Calibration configuration.
+ */
+typedef struct {
+  det_config_t base; /**< Template for the frozen allocator (no classes). */
+  size_t max_classes;     /**< Classes to derive (1..DET_MAX_CLASSES). */
+  unsigned headroom_pct;  /**< Blocks added on top of the observed peak. */
+  det_fallback_alloc_fn fallback_alloc; /**< Warm-up engine (NULL = malloc) */
+  det_fallback_free_fn fallback_free;   /**< Matching free (NULL = free) */
+  void *fallback_user;                  /**< Passed to the fallback engine */
+} det_calib_config_t;
+
+/**
+ * @brief Default calibration config: det_default_config() as base,
+ *        DET_MAX_CLASSES / 2 classes, 25% headroom, malloc/free fallback.
+ */
+DETALLOC_API det_calib_config_t det_calib_default_config(void);
+
+/**
+ * @brief Bytes needed for a det_calib_t (including alignment slack).
+ */
+DETALLOC_API size_t det_calib_size(void);
+
+/**
+ * @brief Start a calibration window over a user-provided buffer.
+ *
+ * @param memory Buffer of at least det_calib_size() bytes
+ * @param size   Size of @p memory
+ * @param config Non-NULL calibration config
+ * @return Calibration handle, or NULL on error
+ */
+DETALLOC_API det_calib_t *det_calib_init(void *memory, size_t size,
+                                         const det_calib_config_t *config);
+
+/**
+ * @brief Allocate @p size bytes.
+ *
+ * Before det_freeze() the request is profiled and served by the fallback
+ * engine (not real-time); afterwards it forwards to det_alloc_sized() on
+ * the frozen allocator and may return NULL if no derived class fits.
+ *
+ * @par Complexity
+ * Warm-up: O(1) profiling plus the fallback engine. Frozen: det_alloc_sized().
+ */
+DETALLOC_API void *det_calib_alloc(det_calib_t *cal, size_t size);
+
+/**
+ * @brief Free a block from det_calib_alloc(), before or after the freeze.
+ *
+ * Blocks inside the frozen arena go to det_free(); warm-up blocks go back
+ * to the fallback engine.
+ */
+DETALLOC_API void det_calib_free(det_calib_t *cal, void *ptr);
+
+/**
+ * @brief Derive the class table from the profile without switching.
+ *
+ * Picks up to config.max_classes block sizes from the histogram buckets so
+ * that the total footprint (block size times peak concurrency) is minimal,
+ * and sizes each class at its summed bucket peaks plus headroom. The result
+ * is config.base with @c classes pointing into @p cal (valid until the next
+ * plan); pass it to det_alloc_size() to size the arena.
+ *
+ * @param cal Calibration handle
+ * @param out Output allocator configuration
+ * @return DET_OK, or DET_ERR_INVALID_PARAM if nothing was profiled
+ *
+ * @par Complexity
+ * O(max_classes * buckets^2); not for RT threads.
+ */
+DETALLOC_API det_error_t det_calib_plan(det_calib_t *cal, det_config_t *out);
+
+/**
+ * @brief Build the planned allocator in @p memory and switch over.
+ *
+ * After this call det_calib_alloc() is a constant-time pool allocation;
+ * the returned allocator may also be used directly.
+ *
+ * @param cal    Calibration handle
+ * @param memory Fresh arena of at least det_alloc_size() of the plan
+ * @param size   Size of @p memory
+ * @return Frozen allocator, or NULL on error (calibration continues)
+ */
+DETALLOC_API det_allocator_t *det_freeze(det_calib_t *cal, void *memory,
+                                         size_t size);
+
+/* ========================================================================== */
+/* Thread-Local Default Allocator                                             */
+/* ========================================================================== */
+#if defined(__GNUC__) || defined(__clang__)
+/**
+ * @def DET_TLS
+ * @brief Storage of the per-thread default allocator.
+ *
+ * Initial-exec: the variable is at a fixed offset from the thread pointer,
+ * so reading it is one load with no __tls_get_addr() call, even from the
+ * shared library. A libdetalloc.so loaded with dlopen() takes 8 bytes of
+ * the static TLS reserve for it.
+ */
+#define DET_TLS __thread __attribute__((tls_model("initial-exec")))
+
+/** The calling thread's default allocator; set it with det_thread_bind(). */
+DETALLOC_API extern DET_TLS det_allocator_t *det_tls_allocator;
+
+/**
+ * @brief Make @p alloc the calling thread's default allocator.
+ *
+ * det_alloc_tls(), det_free_tls() and DET_NEW_TLS() then use it without an
+ * allocator argument; without a binding they return NULL or do nothing.
+ * A plain store, so it is RT-safe. Nothing is released at thread exit:
+ * blocks belong to the allocator, and a thread that may outlive its
+ * allocator should unbind with NULL first.
+ *
+ * @param alloc Allocator to bind, or NULL to unbind
+ * @return DET_OK
+ */
+DETALLOC_API det_error_t det_thread_bind(det_allocator_t *alloc);
+
+/** det_alloc_sized() from the calling thread's default allocator. */
+DET_INLINE void *det_alloc_tls(size_t size) {
+  return det_alloc_sized(det_tls_allocator, size);
+}
+
+/** det_free() into the calling thread's default allocator. */
+DET_INLINE void det_free_tls(void *ptr) { det_free(det_tls_allocator, ptr); }
+
+/** Allocate a typed object from the calling thread's default allocator. */
+#define DET_NEW_TLS(type) ((type *)det_alloc_tls(sizeof(type)))
+#endif
+
 /* ========================================================================== */
 /* Convenience                                                                */
 /* ========================================================================== */
 /**
- * @brief Return a sensible Phase-1 default config.
+ * @brief Return a sensible default config.
  *
  * Defaults:
  *  - block_size = DET_DEFAULT_BLOCK_SIZE
  *  - num_blocks = 0 (must be set by user)
  *  - align      = DET_DEFAULT_ALIGN
  *  - thread_safe = false
+ *  - signal_safe = false
+ *  - high_watermark = low_watermark = 0 (disabled)
+ *  - classes = NULL, num_classes = 0, max_spill = 0
+ *  - track_lifetime = false
+ *  - frame_size = 0 (no frame region)
+ *  - tenant = NULL
+ *  - safe_linking = guard_pages = false
+ *  - shards = 1, shard_probes = 0
  */
 DETALLOC_API det_config_t det_default_config(void);
 
@@ -233,11 +1260,41 @@ DETALLOC_API det_config_t det_default_config(void);
  */
 DETALLOC_API const char *det_version_string(void);
 
+/**
+ * @brief Read the CPU timestamp counter.
+ *
+ * TSC on x86, the virtual counter (CNTVCT_EL0) on AArch64, 0 elsewhere.
+ * Used for WCET and lifetime measurements; not serializing.
+ */
+DET_INLINE uint64_t det_get_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo;
+  uint32_t hi;
+
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t v;
+
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+#else
+  return 0;
+#endif
+}
+
 /* ========================================================================== */
 /* Macros                                                                     */
 /* ========================================================================== */
-/** Allocate a typed object (one fixed-size block must fit it). */
-#define DET_NEW(alloc, type) ((type *)det_alloc((alloc)))
+/** Allocate a typed object from the smallest class that fits it. */
+#define DET_NEW(alloc, type) ((type *)det_alloc_sized((alloc), sizeof(type)))
+
+/** Allocate an array of @p n typed objects in one block; NULL if the byte
+ *  count overflows size_t. Evaluates @p n twice. */
+#define DET_NEW_ARRAY(alloc, type, n)                                          \
+  ((size_t)(n) > SIZE_MAX / sizeof(type)                                       \
+       ? (type *)NULL                                                          \
+       : (type *)det_alloc_sized((alloc), sizeof(type) * (size_t)(n)))
 
 /** Free and null a pointer. */
 #define DET_FREE(alloc, ptr)                                                   \
@@ -0,0 +1,301 @@
+/**
+ * @file detalloc.hpp
+ * @brief C++ size-class sets with compile-time routing
+ *
+ * det::pool_set<64, 128, 256> owns one single-class detalloc instance per
+ * size, all carved from one user-provided arena. make_pooled<T>() picks the
+ * smallest class that holds sizeof(T) at compile time and returns a
+ * pooled_ptr<T> whose deleter has no state: creating an object is one
+ * det_alloc() on that class's instance plus the constructor, destroying it
+ * is the destructor plus one det_free(), with no size lookup on either side.
+ *
+ * Requires C++11. Nothing here throws; an exhausted class yields an empty
+ * pooled_ptr.
+ */
+
+#ifndef DETALLOC_HPP
+#define DETALLOC_HPP
+
+#include "detalloc.h"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace det {
+
+namespace detail {
+
+template <std::size_t... Sizes> struct ascending : std::true_type {};
+
+template <std::size_t A, std::size_t B, std::size_t... Rest>
+struct ascending<A, B, Rest...>
+    : std::integral_constant<bool, (A < B) && ascending<B, Rest...>::value> {};
+
+/* Largest power of two dividing @p size, capped at a cache line. Blocks are
+ * laid out at that stride anyway, so the alignment costs no space. */
+constexpr std::size_t natural_align(std::size_t size) {
+  return (size & (~size + 1)) < 64 ? (size & (~size + 1)) : 64;
+}
+
+} // namespace detail
+
+template <class T, class Set> struct pooled_deleter;
+
+/** Owning pointer to a T built by make_pooled(); as small as a raw pointer. */
+template <class T, class Set>
+using pooled_ptr = std::unique_ptr<T, pooled_deleter<T, Set>>;
+
+/**
+ * @brief A fixed set of size classes, one detalloc instance per class.
+ *
+ * @p Tag only tells sets with the same sizes apart: at most one set of a
+ * given type is live at a time, which is what lets pooled_deleter find it
+ * without storing a pointer. Use pool_set<Sizes...> unless a program needs
+ * two sets with the same sizes.
+ *
+ * All instances share the threading options of the base config passed to
+ * the constructor; classes, frame region and handles are per-allocator
+ * features and are not used here.
+ */
+template <class Tag, std::size_t... Sizes> class basic_pool_set {
+  static_assert(sizeof...(Sizes) > 0, "pool_set needs at least one size");
+  static_assert(detail::ascending<Sizes...>::value,
+                "pool_set sizes must be strictly ascending");
+
+public:
+  /** Number of size classes. */
+  static constexpr std::size_t num_classes = sizeof...(Sizes);
+
+  /** Class serving @p N bytes, or num_classes if none is large enough. */
+  static constexpr std::size_t class_of(std::size_t N) {
+    return class_index_(N, 0);
+  }
+
+  /** Block size of class @p I. */
+  static constexpr std::size_t size_of(std::size_t I) { return sizes_(I); }
+
+  /** Arena bytes needed for @p blocks[i] blocks in class i; 0 on error. */
+  static std::size_t
+  arena_size(const std::size_t (&blocks)[num_classes],
+             const det_config_t &base = det_default_config()) {
+    std::size_t total = 0;
+
+    for (std::size_t i = 0; i < num_classes; i++) {
+      det_config_t cfg = config_(i, blocks[i], base);
+      std::size_t size = det_alloc_size(&cfg);
+
+      if (size == 0) {
+        return 0;
+      }
+      total += size;
+    }
+    return total;
+  }
+
+  /** Arena bytes needed for @p blocks blocks in every class. */
+  static std::size_t
+  arena_size(std::size_t blocks,
+             const det_config_t &base = det_default_config()) {
+    std::size_t n[num_classes];
+
+    for (std::size_t i = 0; i < num_classes; i++) {
+      n[i] = blocks;
+    }
+    return arena_size(n, base);
+  }
+
+  /**
+   * @brief Lay out one instance per class in @p memory.
+   *
+   * Check valid() afterwards: construction fails if the arena is too small,
+   * a config is rejected, or another set of this type is live.
+   */
+  basic_pool_set(void *memory, std::size_t size,
+                 const std::size_t (&blocks)[num_classes],
+                 const det_config_t &base = det_default_config()) noexcept {
+    init_(memory, size, blocks, base);
+  }
+
+  /** As above, with @p blocks blocks in every class. */
+  basic_pool_set(void *memory, std::size_t size, std::size_t blocks,
+                 const det_config_t &base = det_default_config()) noexcept {
+    std::size_t n[num_classes];
+
+    for (std::size_t i = 0; i < num_classes; i++) {
+      n[i] = blocks;
+    }
+    init_(memory, size, n, base);
+  }
+
+  basic_pool_set(const basic_pool_set &) = delete;
+  basic_pool_set &operator=(const basic_pool_set &) = delete;
+
+  /** Destroys every instance; objects still live must not be used after. */
+  ~basic_pool_set() {
+    for (std::size_t i = 0; i < num_classes; i++) {
+      det_alloc_destroy(pools_[i]);
+    }
+    if (current_ == this) {
+      current_ = nullptr;
+    }
+  }
+
+  /** True if every class was initialised and the set is the live one. */
+  bool valid() const noexcept { return current_ == this; }
+
+  /** The live set of this type, or nullptr. */
+  static basic_pool_set *current() noexcept { return current_; }
+
+  /** Instance behind class @p i, e.g. for det_get_stats(). */
+  det_allocator_t *pool(std::size_t i) const noexcept {
+    return i < num_classes ? pools_[i] : nullptr;
+  }
+
+  /** One block of class @p I: a det_alloc() on its instance. */
+  template <std::size_t I> void *allocate() noexcept {
+    static_assert(I < num_classes, "no such size class");
+    return det_alloc(pools_[I]);
+  }
+
+  /** Returns @p ptr to class @p I: a det_free() on its instance. */
+  template <std::size_t I> void deallocate(void *ptr) noexcept {
+    static_assert(I < num_classes, "no such size class");
+    det_free(pools_[I], ptr);
+  }
+
+private:
+  static constexpr std::size_t sizes_(std::size_t i) { return table_[i]; }
+
+  static constexpr std::size_t class_index_(std::size_t n, std::size_t i) {
+    return i == num_classes || n <= sizes_(i) ? i : class_index_(n, i + 1);
+  }
+
+  static constexpr std::size_t table_[num_classes] = {Sizes...};
+
+  static det_config_t config_(std::size_t i, std::size_t blocks,
+                              const det_config_t &base) {
+    det_config_t cfg = base;
+    std::size_t align = detail::natural_align(sizes_(i));
+
+    cfg.block_size = sizes_(i);
+    cfg.num_blocks = blocks;
+    cfg.align = cfg.align > align ? cfg.align : align;
+    cfg.classes = nullptr;
+    cfg.num_classes = 0;
+    cfg.frame_size = 0;
+    cfg.num_handles = 0;
+    return cfg;
+  }
+
+  void init_(void *memory, std::size_t size,
+             const std::size_t (&blocks)[num_classes],
+             const det_config_t &base) noexcept {
+    unsigned char *p = static_cast<unsigned char *>(memory);
+    std::size_t left = size;
+
+    for (std::size_t i = 0; i < num_classes; i++) {
+      pools_[i] = nullptr;
+    }
+    if (current_ != nullptr || memory == nullptr) {
+      return;
+    }
+    for (std::size_t i = 0; i < num_classes; i++) {
+      det_config_t cfg = config_(i, blocks[i], base);
+      std::size_t need = det_alloc_size(&cfg);
+
+      pools_[i] = need != 0 && need <= left ? det_alloc_init(p, need, &cfg)
+                                            : nullptr;
+      if (pools_[i] == nullptr) {
+        /* All or nothing: allocate() on a failed set returns NULL. */
+        while (i-- > 0) {
+          det_alloc_destroy(pools_[i]);
+          pools_[i] = nullptr;
+        }
+        return;
+      }
+      p += need;
+      left -= need;
+    }
+    current_ = this;
+  }
+
+  det_allocator_t *pools_[num_classes];
+  static basic_pool_set *current_;
+};
+
+template <class Tag, std::size_t... Sizes>
+constexpr std::size_t basic_pool_set<Tag, Sizes...>::num_classes;
+
+template <class Tag, std::size_t... Sizes>
+constexpr std::size_t basic_pool_set<Tag, Sizes...>::table_[num_classes];
+
+template <class Tag, std::size_t... Sizes>
+basic_pool_set<Tag, Sizes...> *basic_pool_set<Tag, Sizes...>::current_ =
+    nullptr;
+
+/** The usual set: one live set per list of sizes. */
+template <std::size_t... Sizes> using pool_set = basic_pool_set<void, Sizes...>;
+
+/**
+ * @brief Stateless deleter: destroys the T and frees its block to the class
+ * chosen for sizeof(T) in the live set of type @p Set.
+ *
+ * There is deliberately no conversion from pooled_deleter<Derived, Set>:
+ * the class is fixed by the static type, so a base pointer must not free a
+ * derived object.
+ */
+template <class T, class Set> struct pooled_deleter {
+  void operator()(T *ptr) const noexcept {
+    if (ptr != nullptr) {
+      ptr->~T();
+      Set::current()->template deallocate<Set::class_of(sizeof(T))>(
+          const_cast<typename std::remove_cv<T>::type *>(ptr));
+    }
+  }
+};
+
+/**
+ * @brief Construct a T in the smallest class of @p set that holds it.
+ *
+ * The class is chosen at compile time; a T larger than the largest class,
+ * or more strictly aligned than its class, does not compile. Returns an
+ * empty pointer if the class is exhausted or @p set is not valid(). If the
+ * constructor throws, the block is returned before the exception leaves.
+ */
+template <class T, class Tag, std::size_t... Sizes, class... Args>
+pooled_ptr<T, basic_pool_set<Tag, Sizes...>>
+make_pooled(basic_pool_set<Tag, Sizes...> &set, Args &&...args) {
+  typedef basic_pool_set<Tag, Sizes...> set_type;
+  constexpr std::size_t cls = set_type::class_of(sizeof(T));
+
+  static_assert(cls < set_type::num_classes,
+                "type is larger than every class in the pool_set");
+  static_assert(cls == set_type::num_classes ||
+                    alignof(T) <= detail::natural_align(set_type::size_of(cls)),
+                "type is more strictly aligned than its class");
+
+  struct guard {
+    set_type &set;
+    void *mem;
+    ~guard() {
+      if (mem != nullptr) {
+        set.template deallocate<cls>(mem);
+      }
+    }
+  };
+
+  guard g = {set, set.template allocate<cls>()};
+  if (g.mem == nullptr) {
+    return pooled_ptr<T, set_type>();
+  }
+  T *obj = ::new (g.mem) T(std::forward<Args>(args)...);
+  g.mem = nullptr;
+  return pooled_ptr<T, set_type>(obj);
+}
+
+} // namespace det
+
+#endif /* DETALLOC_HPP */
@@ -0,0 +1,272 @@
+#include <detalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================================== */
+/* Internal Constants                                                         */
+/* ========================================================================== */
+#define DET_CALIB_MAGIC 0x43414C42u /* "CALB" */
+#define DET_CALIB_ALIGN 64u
+
+/* Size buckets: 8-byte steps up to 32 bytes, then four steps per power of
+ * two up to DET_CALIB_MAX_SIZE; larger requests are counted as oversize. */
+#define DET_CALIB_BUCKETS 80u
+#define DET_CALIB_MAX_SIZE ((size_t)1 << 24)
+
+/* Warm-up blocks carry their bucket in a header; 16 bytes keeps the
+ * fallback engine's alignment. */
+#define DET_CALIB_HDR 16u
+
+/* ========================================================================== */
+/* Internal Types                                                             */
+/* ========================================================================== */
+struct det_calib {
+  uint32_t magic;
+  det_calib_config_t config;
+  det_allocator_t *frozen; /* published with release once built */
+  const uint8_t *arena_lo; /* frozen arena bounds, set before frozen */
+  const uint8_t *arena_hi;
+  uint64_t oversize;
+  uint64_t requests[DET_CALIB_BUCKETS];
+  size_t live[DET_CALIB_BUCKETS];
+  size_t peak[DET_CALIB_BUCKETS];
+  det_class_config_t classes[DET_MAX_CLASSES];
+};
+
+/* ========================================================================== */
+/* Helpers                                                                    */
+/* ========================================================================== */
+static void *det_calib_malloc(void *user, size_t size) {
+  (void)user;
+  return malloc(size);
+}
+
+static void det_calib_release(void *user, void *ptr) {
+  (void)user;
+  free(ptr);
+}
+
+static unsigned det_floor_log2(size_t v) {
+  return (unsigned)(sizeof(unsigned long long) * 8u - 1u) -
+         (unsigned)__builtin_clzll((unsigned long long)v);
+}
+
+static unsigned det_calib_bucket(size_t size) {
+  unsigned e;
+
+  if (size <= 32) {
+    return size == 0 ? 0 : (unsigned)((size - 1) / 8);
+  }
+  e = det_floor_log2(size - 1);
+  return 4u + (e - 5u) * 4u +
+         (unsigned)(((size - 1) - ((size_t)1 << e)) >> (e - 2u));
+}
+
+static size_t det_calib_upper(unsigned bucket) {
+  unsigned e;
+
+  if (bucket < 4) {
+    return (size_t)(bucket + 1) * 8u;
+  }
+  e = 5u + (bucket - 4u) / 4u;
+  return ((size_t)1 << e) + (size_t)((bucket - 4u) % 4u + 1u) *
+                                ((size_t)1 << (e - 2u));
+}
+
+/* ========================================================================== */
+/* Calibration API                                                            */
+/* ========================================================================== */
+det_calib_config_t det_calib_default_config(void) {
+  det_calib_config_t cfg;
+
+  cfg.base = det_default_config();
+  cfg.max_classes = DET_MAX_CLASSES / 2;
+  cfg.headroom_pct = 25;
+  cfg.fallback_alloc = NULL;
+  cfg.fallback_free = NULL;
+  cfg.fallback_user = NULL;
+
+  return cfg;
+}
+
+size_t det_calib_size(void) {
+  return sizeof(det_calib_t) + DET_CALIB_ALIGN - 1;
+}
+
+det_calib_t *det_calib_init(void *memory, size_t size,
+                            const det_calib_config_t *config) {
+  det_calib_t *cal;
+  uintptr_t start;
+
+  if (memory == NULL || config == NULL || config->max_classes == 0 ||
+      config->max_classes > DET_MAX_CLASSES ||
+      (config->fallback_alloc == NULL) != (config->fallback_free == NULL)) {
+    return NULL;
+  }
+  start = DET_ALIGN_UP((uintptr_t)memory, (uintptr_t)DET_CALIB_ALIGN);
+  if (start - (uintptr_t)memory > size ||
+      size - (start - (uintptr_t)memory) < sizeof(det_calib_t)) {
+    return NULL;
+  }
+
+  cal = (det_calib_t *)start;
+  memset(cal, 0, sizeof(*cal));
+  cal->config = *config;
+  if (cal->config.fallback_alloc == NULL) {
+    cal->config.fallback_alloc = det_calib_malloc;
+    cal->config.fallback_free = det_calib_release;
+  }
+  cal->magic = DET_CALIB_MAGIC;
+  return cal;
+}
+
+void *det_calib_alloc(det_calib_t *cal, size_t size) {
+  det_allocator_t *frozen;
+  uint8_t *raw;
+  unsigned bucket;
+  size_t live;
+  size_t peak;
+
+  if (cal == NULL) {
+    return NULL;
+  }
+  frozen = __atomic_load_n(&cal->frozen, __ATOMIC_ACQUIRE);
+  if (frozen != NULL) {
+    return det_alloc_sized(frozen, size);
+  }
+  if (size > SIZE_MAX - DET_CALIB_HDR) {
+    return NULL;
+  }
+  raw = (uint8_t *)cal->config.fallback_alloc(cal->config.fallback_user,
+                                              size + DET_CALIB_HDR);
+  if (raw == NULL) {
+    return NULL;
+  }
+
+  bucket = size > DET_CALIB_MAX_SIZE ? DET_CALIB_BUCKETS
+                                     : det_calib_bucket(size);
+  memcpy(raw, &bucket, sizeof(bucket));
+  if (bucket == DET_CALIB_BUCKETS) {
+    __atomic_fetch_add(&cal->oversize, 1, __ATOMIC_RELAXED);
+    return raw + DET_CALIB_HDR;
+  }
+  __atomic_fetch_add(&cal->requests[bucket], 1, __ATOMIC_RELAXED);
+  live = __atomic_add_fetch(&cal->live[bucket], 1, __ATOMIC_RELAXED);
+  peak = __atomic_load_n(&cal->peak[bucket], __ATOMIC_RELAXED);
+  while (live > peak &&
+         !__atomic_compare_exchange_n(&cal->peak[bucket], &peak, live, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+  return raw + DET_CALIB_HDR;
+}
+
+void det_calib_free(det_calib_t *cal, void *ptr) {
+  det_allocator_t *frozen;
+  const uint8_t *p = (const uint8_t *)ptr;
+  uint8_t *raw;
+  unsigned bucket;
+
+  if (cal == NULL || ptr == NULL) {
+    return;
+  }
+  frozen = __atomic_load_n(&cal->frozen, __ATOMIC_ACQUIRE);
+  if (frozen != NULL && p >= cal->arena_lo && p < cal->arena_hi) {
+    det_free(frozen, ptr);
+    return;
+  }
+  raw = (uint8_t *)ptr - DET_CALIB_HDR;
+  memcpy(&bucket, raw, sizeof(bucket));
+  if (bucket < DET_CALIB_BUCKETS) {
+    __atomic_fetch_sub(&cal->live[bucket], 1, __ATOMIC_RELAXED);
+  }
+  cal->config.fallback_free(cal->config.fallback_user, raw);
+}
+
+det_error_t det_calib_plan(det_calib_t *cal, det_config_t *out) {
+  /* best[c][j]: least footprint covering used buckets 0..j with c+1 classes,
+   * the last of which is sized by bucket j. */
+  uint64_t best[DET_MAX_CLASSES][DET_CALIB_BUCKETS];
+  unsigned from[DET_MAX_CLASSES][DET_CALIB_BUCKETS];
+  unsigned used[DET_CALIB_BUCKETS];
+  uint64_t prefix[DET_CALIB_BUCKETS + 1];
+  unsigned n = 0;
+  unsigned k;
+  unsigned c;
+  unsigned i;
+  unsigned j;
+
+  if (cal == NULL || out == NULL || cal->magic != DET_CALIB_MAGIC) {
+    return DET_ERR_INVALID_PARAM;
+  }
+  prefix[0] = 0;
+  for (i = 0; i < DET_CALIB_BUCKETS; i++) {
+    if (__atomic_load_n(&cal->requests[i], __ATOMIC_RELAXED) != 0) {
+      used[n] = i;
+      prefix[n + 1] =
+          prefix[n] + __atomic_load_n(&cal->peak[i], __ATOMIC_RELAXED);
+      n++;
+    }
+  }
+  if (n == 0) {
+    return DET_ERR_INVALID_PARAM;
+  }
+  k = cal->config.max_classes < n ? (unsigned)cal->config.max_classes : n;
+
+  for (j = 0; j < n; j++) {
+    best[0][j] = det_calib_upper(used[j]) * prefix[j + 1];
+    from[0][j] = 0;
+  }
+  for (c = 1; c < k; c++) {
+    for (j = c; j < n; j++) {
+      uint64_t upper = det_calib_upper(used[j]);
+
+      best[c][j] = UINT64_MAX;
+      for (i = c - 1; i < j; i++) {
+        uint64_t cost =
+            best[c - 1][i] + upper * (prefix[j + 1] - prefix[i + 1]);
+
+        if (cost < best[c][j]) {
+          best[c][j] = cost;
+          from[c][j] = i;
+        }
+      }
+    }
+  }
+
+  /* Walk back from the largest bucket, filling classes top-down. */
+  j = n - 1;
+  for (c = k; c-- > 0;) {
+    unsigned first = c == 0 ? 0 : from[c][j] + 1;
+    uint64_t blocks = prefix[j + 1] - prefix[first];
+
+    blocks += (blocks * cal->config.headroom_pct + 99u) / 100u;
+    cal->classes[c].block_size = det_calib_upper(used[j]);
+    cal->classes[c].num_blocks = blocks != 0 ? (size_t)blocks : 1;
+    j = first - 1;
+  }
+
+  *out = cal->config.base;
+  out->classes = cal->classes;
+  out->num_classes = k;
+  return DET_OK;
+}
+
+det_allocator_t *det_freeze(det_calib_t *cal, void *memory, size_t size) {
+  det_config_t cfg;
+  det_allocator_t *frozen;
+
+  if (cal == NULL || memory == NULL ||
+      __atomic_load_n(&cal->frozen, __ATOMIC_ACQUIRE) != NULL ||
+      det_calib_plan(cal, &cfg) != DET_OK) {
+    return NULL;
+  }
+  frozen = det_alloc_init(memory, size, &cfg);
+  if (frozen == NULL) {
+    return NULL;
+  }
+  cal->arena_lo = (const uint8_t *)memory;
+  cal->arena_hi = (const uint8_t *)memory + size;
+  __atomic_store_n(&cal->frozen, frozen, __ATOMIC_RELEASE);
+  return frozen;
+}
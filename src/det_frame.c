@@ -0,0 +1,252 @@
+#include <detalloc.h>
+
+#include "det_libc.h"
+
+/* ========================================================================== */
+/* Internal Constants                                                         */
+/* ========================================================================== */
+#define DET_FRAME_MAGIC 0x4652414Du /* "FRAM" */
+#define DET_FRAME_ALIGN 64u
+
+/* ========================================================================== */
+/* Internal Types                                                             */
+/* ========================================================================== */
+typedef struct {
+  uint8_t *base;
+  size_t used; /* may run past arena_size after failed bumps */
+} det_frame_arena_t;
+
+struct det_frame_alloc {
+  uint32_t magic;
+  unsigned num_arenas;
+  size_t arena_size;
+  size_t align;
+  size_t chunk_size;
+  uint64_t frame;   /* written by det_frame_advance() only */
+  uint64_t retired; /* written by det_frame_retire() only */
+  size_t last_hwm;
+  size_t max_hwm;
+  uint64_t failures;
+  uint64_t stalls;
+  det_frame_arena_t arenas[DET_FRAME_MAX_ARENAS];
+};
+
+typedef struct {
+  size_t header;
+  size_t arena;
+  size_t align;
+  size_t chunk;
+} det_frame_layout_t;
+
+/* ========================================================================== */
+/* Helpers                                                                    */
+/* ========================================================================== */
+static bool det_frame_layout(const det_frame_config_t *config,
+                             det_frame_layout_t *lay) {
+  size_t a;
+
+  if (config == NULL || config->arena_size == 0 || config->num_arenas < 2 ||
+      config->num_arenas > DET_FRAME_MAX_ARENAS || config->align == 0 ||
+      (config->align & (config->align - 1)) != 0 ||
+      config->align > config->arena_size) {
+    return false;
+  }
+  lay->align = config->align;
+  a = lay->align > DET_FRAME_ALIGN ? lay->align : DET_FRAME_ALIGN;
+  lay->header = DET_ALIGN_UP(sizeof(det_frame_alloc_t), a);
+  if (config->arena_size > (SIZE_MAX - lay->header - 2 * a) /
+                               config->num_arenas ||
+      config->chunk_size > config->arena_size) {
+    return false;
+  }
+  lay->arena = DET_ALIGN_UP(config->arena_size, a);
+  lay->chunk = DET_ALIGN_UP(config->chunk_size, lay->align);
+  return true;
+}
+
+/* Reserves up to @p want bytes (at least @p need) of @p frame's arena and
+ * stores the granted length in @p got; NULL if not even @p need fits. */
+static uint8_t *det_frame_take(det_frame_alloc_t *fa, uint64_t frame,
+                               size_t need, size_t want, size_t *got) {
+  det_frame_arena_t *ar = &fa->arenas[frame % fa->num_arenas];
+  size_t off = __atomic_fetch_add(&ar->used, want, __ATOMIC_RELAXED);
+
+  /* A partial chunk at the end of the arena is still usable. */
+  if (off >= fa->arena_size || fa->arena_size - off < need) {
+    __atomic_fetch_add(&fa->failures, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  *got = fa->arena_size - off < want ? fa->arena_size - off : want;
+  return ar->base + off;
+}
+
+/* ========================================================================== */
+/* Frame Allocator API                                                        */
+/* ========================================================================== */
+det_frame_config_t det_frame_default_config(void) {
+  det_frame_config_t cfg;
+
+  cfg.arena_size = 0;
+  cfg.num_arenas = 2;
+  cfg.align = DET_DEFAULT_ALIGN;
+  cfg.chunk_size = 4096;
+
+  return cfg;
+}
+
+size_t det_frame_alloc_size(const det_frame_config_t *config) {
+  det_frame_layout_t lay;
+
+  if (!det_frame_layout(config, &lay)) {
+    return 0;
+  }
+  return lay.header + lay.arena * config->num_arenas +
+         (lay.align > DET_FRAME_ALIGN ? lay.align : DET_FRAME_ALIGN) - 1;
+}
+
+det_frame_alloc_t *det_frame_alloc_init(void *memory, size_t size,
+                                        const det_frame_config_t *config) {
+  det_frame_layout_t lay;
+  det_frame_alloc_t *fa;
+  uintptr_t start;
+  size_t a;
+  unsigned i;
+
+  if (memory == NULL || !det_frame_layout(config, &lay)) {
+    return NULL;
+  }
+  a = lay.align > DET_FRAME_ALIGN ? lay.align : DET_FRAME_ALIGN;
+  start = DET_ALIGN_UP((uintptr_t)memory, (uintptr_t)a);
+  if (start - (uintptr_t)memory > size ||
+      size - (start - (uintptr_t)memory) <
+          lay.header + lay.arena * config->num_arenas) {
+    return NULL;
+  }
+
+  fa = (det_frame_alloc_t *)start;
+  memset(fa, 0, sizeof(*fa));
+  fa->num_arenas = config->num_arenas;
+  fa->arena_size = lay.arena;
+  fa->align = lay.align;
+  fa->chunk_size = lay.chunk;
+  for (i = 0; i < fa->num_arenas; i++) {
+    fa->arenas[i].base = (uint8_t *)start + lay.header + lay.arena * i;
+  }
+  fa->magic = DET_FRAME_MAGIC;
+  return fa;
+}
+
+void *det_frame_alloc(det_frame_alloc_t *fa, det_frame_cache_t *cache,
+                      size_t size) {
+  uint64_t frame;
+  uint8_t *p;
+  size_t need;
+  size_t got;
+
+  if (fa == NULL || fa->magic != DET_FRAME_MAGIC) {
+    return NULL;
+  }
+  if (size > fa->arena_size) {
+    __atomic_fetch_add(&fa->failures, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  need = DET_ALIGN_UP(size != 0 ? size : 1, fa->align);
+  frame = __atomic_load_n(&fa->frame, __ATOMIC_ACQUIRE);
+
+  if (cache == NULL || need > fa->chunk_size / 2) {
+    return det_frame_take(fa, frame, need, need, &got);
+  }
+  if (cache->frame == frame + 1 && (size_t)(cache->end - cache->cur) >= need) {
+    p = cache->cur;
+    cache->cur += need;
+    return p;
+  }
+  /* Stale or exhausted: the rest of the old chunk is abandoned. */
+  p = det_frame_take(fa, frame, need, fa->chunk_size, &got);
+  if (p == NULL) {
+    cache->frame = 0;
+    return NULL;
+  }
+  cache->cur = p + need;
+  cache->end = p + got;
+  cache->frame = frame + 1;
+  return p;
+}
+
+det_error_t det_frame_advance(det_frame_alloc_t *fa, uint64_t *frame) {
+  det_frame_arena_t *ar;
+  uint64_t cur;
+  uint64_t next;
+  size_t hwm;
+
+  if (fa == NULL || fa->magic != DET_FRAME_MAGIC) {
+    return DET_ERR_INVALID_PARAM;
+  }
+  cur = fa->frame;
+  next = cur + 1;
+  /* The arena of frame next was last used by frame next - num_arenas. */
+  if (next >= fa->num_arenas &&
+      next - fa->num_arenas >=
+          __atomic_load_n(&fa->retired, __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&fa->stalls, fa->stalls + 1, __ATOMIC_RELAXED);
+    return DET_ERR_BUSY;
+  }
+
+  hwm = __atomic_load_n(&fa->arenas[cur % fa->num_arenas].used,
+                        __ATOMIC_RELAXED);
+  if (hwm > fa->arena_size) {
+    hwm = fa->arena_size;
+  }
+  __atomic_store_n(&fa->last_hwm, hwm, __ATOMIC_RELAXED);
+  if (hwm > fa->max_hwm) {
+    __atomic_store_n(&fa->max_hwm, hwm, __ATOMIC_RELAXED);
+  }
+
+  ar = &fa->arenas[next % fa->num_arenas];
+  __atomic_store_n(&ar->used, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&fa->frame, next, __ATOMIC_RELEASE);
+  if (frame != NULL) {
+    *frame = next;
+  }
+  return DET_OK;
+}
+
+void det_frame_retire(det_frame_alloc_t *fa, uint64_t frame) {
+  uint64_t retired;
+
+  if (fa == NULL || fa->magic != DET_FRAME_MAGIC) {
+    return;
+  }
+  /* Monotonic; the current frame cannot be retired while it is written. */
+  retired = __atomic_load_n(&fa->retired, __ATOMIC_RELAXED);
+  if (frame < __atomic_load_n(&fa->frame, __ATOMIC_ACQUIRE) &&
+      frame + 1 > retired) {
+    __atomic_store_n(&fa->retired, frame + 1, __ATOMIC_RELEASE);
+  }
+}
+
+det_error_t det_frame_get_stats(const det_frame_alloc_t *fa,
+                                det_frame_stats_t *stats) {
+  uint64_t frame;
+
+  if (fa == NULL || stats == NULL) {
+    return DET_ERR_INVALID_PARAM;
+  }
+  if (fa->magic != DET_FRAME_MAGIC) {
+    return DET_ERR_NOT_INITIALIZED;
+  }
+  frame = __atomic_load_n(&fa->frame, __ATOMIC_ACQUIRE);
+  stats->frame = frame;
+  stats->retired = __atomic_load_n(&fa->retired, __ATOMIC_RELAXED);
+  stats->arena_size = fa->arena_size;
+  stats->used = __atomic_load_n(&fa->arenas[frame % fa->num_arenas].used,
+                                __ATOMIC_RELAXED);
+  if (stats->used > fa->arena_size) {
+    stats->used = fa->arena_size;
+  }
+  stats->last_hwm = __atomic_load_n(&fa->last_hwm, __ATOMIC_RELAXED);
+  stats->max_hwm = __atomic_load_n(&fa->max_hwm, __ATOMIC_RELAXED);
+  stats->failures = __atomic_load_n(&fa->failures, __ATOMIC_RELAXED);
+  stats->stalls = __atomic_load_n(&fa->stalls, __ATOMIC_RELAXED);
+  return DET_OK;
+}
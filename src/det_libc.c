@@ -0,0 +1,37 @@
+/* det_libc.c - libc routines for RT_ALLOC_FREESTANDING builds
+ *
+ * Only compiled by `make freestanding`. Byte loops keep them small and their
+ * time linear in n; build with -fno-tree-loop-distribute-patterns so the
+ * compiler does not turn them back into calls to themselves.
+ */
+#include "det_libc.h"
+
+void *memset(void *s, int c, size_t n) {
+  unsigned char *p = (unsigned char *)s;
+
+  while (n != 0) {
+    *p++ = (unsigned char)c;
+    n--;
+  }
+  return s;
+}
+
+void *memcpy(void *restrict dst, const void *restrict src, size_t n) {
+  unsigned char *d = (unsigned char *)dst;
+  const unsigned char *s = (const unsigned char *)src;
+
+  while (n != 0) {
+    *d++ = *s++;
+    n--;
+  }
+  return dst;
+}
+
+size_t strlen(const char *s) {
+  const char *p = s;
+
+  while (*p != '\0') {
+    p++;
+  }
+  return (size_t)(p - s);
+}
@@ -0,0 +1,18 @@
+#ifndef DET_LIBC_H
+#define DET_LIBC_H
+
+/* The string routines the allocator core calls. Hosted builds take them from
+ * <string.h>; RT_ALLOC_FREESTANDING builds may only use the C99 freestanding
+ * headers, so they declare them here and link det_libc.c (or the target's
+ * own runtime). */
+#include <stddef.h>
+
+#if defined(RT_ALLOC_FREESTANDING)
+void *memset(void *s, int c, size_t n);
+void *memcpy(void *restrict dst, const void *restrict src, size_t n);
+size_t strlen(const char *s);
+#else
+#include <string.h>
+#endif
+
+#endif /* DET_LIBC_H */
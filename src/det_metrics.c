@@ -0,0 +1,319 @@
+#include <detalloc.h>
+
+#include <stddef.h>
+#include <string.h>
+
+/* ========================================================================== */
+/* Internal Types                                                             */
+/* ========================================================================== */
+/* Output cursor; once a write does not fit, ok stays false and later writes
+ * are dropped, so callers check once at the end. */
+typedef struct {
+  char *pos;
+  char *end;
+  bool ok;
+} det_om_out_t;
+
+/* A pre-rendered label set (inside the braces); the tenant escapes to at
+ * most twice its length. */
+typedef struct {
+  char text[2 * DET_TENANT_MAX + 96];
+  size_t len;
+} det_om_labels_t;
+
+typedef enum { DET_OM_SIZE, DET_OM_U64, DET_OM_BOOL } det_om_kind_t;
+
+/* One per-pool scalar family, read from det_pool_stats_t by offset. */
+typedef struct {
+  const char *name;
+  const char *type; /* "gauge" or "counter" */
+  const char *help;
+  size_t offset;
+  det_om_kind_t kind;
+} det_om_scalar_t;
+
+/* One per-pool histogram family: log2 buckets of cycles. */
+typedef struct {
+  const char *name;
+  const char *help;
+  size_t offset;
+  unsigned buckets;
+} det_om_hist_t;
+
+/* ========================================================================== */
+/* Metric Tables                                                              */
+/* ========================================================================== */
+#define DET_OM_POOL(field) offsetof(det_pool_stats_t, field)
+
+static const det_om_scalar_t det_om_scalars[] = {
+    {"detalloc_pool_blocks", "gauge", "Capacity of the pool in blocks.",
+     DET_OM_POOL(num_blocks), DET_OM_SIZE},
+    {"detalloc_pool_in_use", "gauge", "Blocks currently allocated.",
+     DET_OM_POOL(in_use), DET_OM_SIZE},
+    {"detalloc_pool_peak_in_use", "gauge", "Highest in_use observed.",
+     DET_OM_POOL(peak_in_use), DET_OM_SIZE},
+    {"detalloc_pool_allocs", "counter", "Blocks handed out by the pool.",
+     DET_OM_POOL(allocs), DET_OM_U64},
+    {"detalloc_pool_frees", "counter", "Blocks returned to the pool.",
+     DET_OM_POOL(frees), DET_OM_U64},
+    {"detalloc_pool_failures", "counter",
+     "Requests for this class that got NULL.", DET_OM_POOL(failures),
+     DET_OM_U64},
+    {"detalloc_pool_spilled_out", "counter",
+     "Requests for this class served by a larger one.",
+     DET_OM_POOL(spilled_out), DET_OM_U64},
+    {"detalloc_pool_spilled_in", "counter",
+     "Blocks handed out for a smaller class.", DET_OM_POOL(spilled_in),
+     DET_OM_U64},
+    {"detalloc_pool_link_faults", "counter",
+     "Corrupted free-list links dropped.", DET_OM_POOL(link_faults),
+     DET_OM_U64},
+    {"detalloc_pool_above_watermark", "gauge",
+     "1 between a high and the next low watermark crossing.",
+     DET_OM_POOL(above_watermark), DET_OM_BOOL},
+    {"detalloc_pool_alloc_wcet_cycles", "gauge",
+     "Slowest allocation for this class.", DET_OM_POOL(alloc_wcet),
+     DET_OM_U64},
+    {"detalloc_pool_free_wcet_cycles", "gauge",
+     "Slowest free into this class.", DET_OM_POOL(free_wcet), DET_OM_U64},
+};
+
+static const det_om_hist_t det_om_hists[] = {
+    {"detalloc_pool_alloc_latency_cycles", "Allocation latency.",
+     DET_OM_POOL(alloc_latency_hist), DET_LATENCY_BUCKETS},
+    {"detalloc_pool_free_latency_cycles", "Free latency.",
+     DET_OM_POOL(free_latency_hist), DET_LATENCY_BUCKETS},
+    {"detalloc_pool_lifetime_cycles", "Alloc-to-free time of blocks.",
+     DET_OM_POOL(lifetime_hist), DET_LIFETIME_BUCKETS},
+};
+
+static const char *const det_om_lifetimes[] = {"any", "short", "long",
+                                               "frame"};
+
+/* ========================================================================== */
+/* Formatting                                                                 */
+/* ========================================================================== */
+static void det_om_raw(det_om_out_t *out, const char *s, size_t n) {
+  if (!out->ok || n > (size_t)(out->end - out->pos)) {
+    out->ok = false;
+    return;
+  }
+  memcpy(out->pos, s, n);
+  out->pos += n;
+}
+
+static void det_om_str(det_om_out_t *out, const char *s) {
+  det_om_raw(out, s, strlen(s));
+}
+
+static void det_om_u64(det_om_out_t *out, uint64_t v) {
+  char digits[20];
+  size_t n = sizeof(digits);
+
+  do {
+    digits[--n] = (char)('0' + v % 10u);
+    v /= 10u;
+  } while (v != 0);
+  det_om_raw(out, digits + n, sizeof(digits) - n);
+}
+
+/* Label value escaping per the exposition format: \\, \" and \n. */
+static void det_om_escaped(det_om_out_t *out, const char *s) {
+  for (; *s != '\0'; s++) {
+    if (*s == '\\') {
+      det_om_raw(out, "\\\\", 2);
+    } else if (*s == '"') {
+      det_om_raw(out, "\\\"", 2);
+    } else if (*s == '\n') {
+      det_om_raw(out, "\\n", 2);
+    } else {
+      det_om_raw(out, s, 1);
+    }
+  }
+}
+
+static void det_om_family(det_om_out_t *out, const char *name,
+                          const char *type, const char *help) {
+  det_om_str(out, "# TYPE ");
+  det_om_str(out, name);
+  det_om_raw(out, " ", 1);
+  det_om_str(out, type);
+  det_om_str(out, "\n# HELP ");
+  det_om_str(out, name);
+  det_om_raw(out, " ", 1);
+  det_om_str(out, help);
+  det_om_raw(out, "\n", 1);
+}
+
+/* Renders the label set of @p pool once per document; SIZE_MAX stands for
+ * allocator-wide samples (tenant only). */
+static void det_om_labels(det_om_labels_t *lab, const det_stats_t *stats,
+                          size_t pool) {
+  det_om_out_t out;
+
+  out.pos = lab->text;
+  out.end = lab->text + sizeof(lab->text);
+  out.ok = true;
+  if (stats->tenant[0] != '\0') {
+    det_om_str(&out, "tenant=\"");
+    det_om_escaped(&out, stats->tenant);
+    det_om_str(&out, pool != SIZE_MAX ? "\"," : "\"");
+  }
+  if (pool != SIZE_MAX) {
+    const det_pool_stats_t *ps = &stats->pool_stats[pool];
+
+    det_om_str(&out, "pool=\"");
+    det_om_u64(&out, pool);
+    det_om_str(&out, "\",block_size=\"");
+    det_om_u64(&out, ps->block_size);
+    det_om_str(&out, "\",lifetime=\"");
+    det_om_str(&out, (unsigned)ps->lifetime < 4u
+                         ? det_om_lifetimes[ps->lifetime]
+                         : "any");
+    det_om_raw(&out, "\"", 1);
+  }
+  lab->len = (size_t)(out.pos - lab->text);
+}
+
+/* Writes "name{labels" without the closing brace, so callers can append
+ * more labels; no brace at all for an empty label set. */
+static void det_om_open(det_om_out_t *out, const char *name,
+                        const char *suffix, const det_om_labels_t *lab) {
+  det_om_str(out, name);
+  det_om_str(out, suffix);
+  if (lab->len != 0) {
+    det_om_raw(out, "{", 1);
+    det_om_raw(out, lab->text, lab->len);
+  }
+}
+
+static void det_om_close(det_om_out_t *out, const det_om_labels_t *lab,
+                         uint64_t value) {
+  det_om_str(out, lab->len != 0 ? "} " : " ");
+  det_om_u64(out, value);
+  det_om_raw(out, "\n", 1);
+}
+
+static void det_om_sample(det_om_out_t *out, const char *name,
+                          const char *suffix, const det_om_labels_t *lab,
+                          uint64_t value) {
+  det_om_open(out, name, suffix, lab);
+  det_om_close(out, lab, value);
+}
+
+static uint64_t det_om_scalar(const det_pool_stats_t *ps,
+                              const det_om_scalar_t *m) {
+  const unsigned char *field = (const unsigned char *)ps + m->offset;
+  size_t sz;
+  uint64_t u;
+  bool b;
+
+  switch (m->kind) {
+  case DET_OM_SIZE:
+    memcpy(&sz, field, sizeof(sz));
+    return sz;
+  case DET_OM_BOOL:
+    memcpy(&b, field, sizeof(b));
+    return b ? 1u : 0u;
+  default:
+    memcpy(&u, field, sizeof(u));
+    return u;
+  }
+}
+
+static void det_om_histogram(det_om_out_t *out, const det_stats_t *stats,
+                             const det_om_labels_t *labels,
+                             const det_om_hist_t *h) {
+  size_t i;
+  unsigned b;
+
+  det_om_family(out, h->name, "histogram", h->help);
+  for (i = 0; i < stats->num_pools; i++) {
+    const unsigned char *ps = (const unsigned char *)&stats->pool_stats[i];
+    const uint64_t *bins = (const uint64_t *)(const void *)(ps + h->offset);
+    uint64_t cum = 0;
+
+    /* Bin b holds [2^b, 2^(b+1)) (bin 0 also 0 and 1); counts are whole
+     * cycles, so its inclusive le bound is 2^(b+1) - 1. The last bin is
+     * open-ended, so it only appears in +Inf. No sum is kept, and OpenMetrics
+     * then forbids _count; +Inf carries it. */
+    for (b = 0; b + 1 < h->buckets; b++) {
+      cum += bins[b];
+      det_om_open(out, h->name, "_bucket", &labels[i]);
+      det_om_str(out, ",le=\"");
+      det_om_u64(out, ((uint64_t)1 << (b + 1)) - 1u);
+      det_om_raw(out, "\"", 1);
+      det_om_close(out, &labels[i], cum);
+    }
+    cum += bins[h->buckets - 1];
+    det_om_open(out, h->name, "_bucket", &labels[i]);
+    det_om_str(out, ",le=\"+Inf\"");
+    det_om_close(out, &labels[i], cum);
+  }
+}
+
+/* ========================================================================== */
+/* OpenMetrics Exposition                                                     */
+/* ========================================================================== */
+size_t det_stats_format_openmetrics(const det_allocator_t *alloc, char *buf,
+                                    size_t len) {
+  det_stats_t stats;
+  det_om_labels_t labels[DET_MAX_CLASSES];
+  det_om_labels_t global;
+  det_om_out_t out;
+  size_t m;
+  size_t i;
+
+  if (buf == NULL || len == 0 || det_get_stats(alloc, &stats) != DET_OK) {
+    return 0;
+  }
+  for (i = 0; i < stats.num_pools; i++) {
+    det_om_labels(&labels[i], &stats, i);
+  }
+  det_om_labels(&global, &stats, SIZE_MAX);
+  out.pos = buf;
+  out.end = buf + len - 1; /* room for the NUL */
+  out.ok = true;
+
+  for (m = 0; m < sizeof(det_om_scalars) / sizeof(det_om_scalars[0]); m++) {
+    const det_om_scalar_t *sc = &det_om_scalars[m];
+    const char *suffix =
+        sc->type[0] == 'c' ? "_total" : ""; /* counters end in _total */
+
+    det_om_family(&out, sc->name, sc->type, sc->help);
+    for (i = 0; i < stats.num_pools; i++) {
+      det_om_sample(&out, sc->name, suffix, &labels[i],
+                    det_om_scalar(&stats.pool_stats[i], sc));
+    }
+  }
+  for (m = 0; m < sizeof(det_om_hists) / sizeof(det_om_hists[0]); m++) {
+    det_om_histogram(&out, &stats, labels, &det_om_hists[m]);
+  }
+
+  if (stats.frame_size != 0) {
+    det_om_family(&out, "detalloc_frame_size_bytes", "gauge",
+                  "Frame region capacity.");
+    det_om_sample(&out, "detalloc_frame_size_bytes", "", &global,
+                  stats.frame_size);
+    det_om_family(&out, "detalloc_frame_used_bytes", "gauge",
+                  "Frame bytes handed out since the last reset.");
+    det_om_sample(&out, "detalloc_frame_used_bytes", "", &global,
+                  stats.frame_used);
+    det_om_family(&out, "detalloc_frame_peak_bytes", "gauge",
+                  "Highest frame_used observed.");
+    det_om_sample(&out, "detalloc_frame_peak_bytes", "", &global,
+                  stats.frame_peak);
+    det_om_family(&out, "detalloc_frame_failures", "counter",
+                  "Frame requests that did not fit.");
+    det_om_sample(&out, "detalloc_frame_failures", "_total", &global,
+                  stats.frame_failures);
+  }
+  det_om_str(&out, "# EOF\n");
+
+  if (!out.ok) {
+    buf[0] = '\0';
+    return 0;
+  }
+  *out.pos = '\0';
+  return (size_t)(out.pos - buf);
+}
@@ -0,0 +1,73 @@
+#include <detalloc.h>
+
+#include <string.h>
+
+/* ========================================================================== */
+/* Internal Constants                                                         */
+/* ========================================================================== */
+/* A publish is O(pools); a reader that loses this many races in a row is
+ * better off reporting DET_ERR_BUSY and trying again on its next tick. */
+#define DET_SHM_READ_TRIES 64u
+
+/* ========================================================================== */
+/* Shared-Memory Statistics                                                   */
+/* ========================================================================== */
+det_shm_stats_t *det_shm_init(void *memory, size_t size) {
+  det_shm_stats_t *page = (det_shm_stats_t *)memory;
+
+  if (memory == NULL || size < sizeof(*page) ||
+      (uintptr_t)memory % sizeof(uint64_t) != 0) {
+    return NULL;
+  }
+  memset(page, 0, sizeof(*page));
+  page->version = DET_SHM_VERSION;
+  page->layout_size = (uint32_t)sizeof(*page);
+  __atomic_store_n(&page->magic, DET_SHM_MAGIC, __ATOMIC_RELEASE);
+  return page;
+}
+
+det_error_t det_stats_publish(const det_allocator_t *alloc,
+                              det_shm_stats_t *page) {
+  uint32_t seq;
+  det_error_t err;
+
+  if (page == NULL || page->magic != DET_SHM_MAGIC) {
+    return DET_ERR_INVALID_PARAM;
+  }
+  /* Single writer: seq is only written here, so no read-modify-write. */
+  seq = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&page->seq, seq + 1u, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  err = det_get_stats(alloc, &page->stats);
+  if (err == DET_OK) {
+    page->cycles = det_get_cycles();
+    page->publishes++;
+  }
+  __atomic_store_n(&page->seq, seq + 2u, __ATOMIC_RELEASE);
+  return err;
+}
+
+det_error_t det_shm_read(const det_shm_stats_t *page, det_shm_stats_t *out) {
+  unsigned tries;
+
+  if (page == NULL || out == NULL ||
+      __atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != DET_SHM_MAGIC ||
+      page->version != DET_SHM_VERSION ||
+      page->layout_size != (uint32_t)sizeof(*page)) {
+    return DET_ERR_INVALID_PARAM;
+  }
+  for (tries = 0; tries < DET_SHM_READ_TRIES; tries++) {
+    uint32_t begin = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+
+    if ((begin & 1u) != 0) {
+      continue;
+    }
+    memcpy(out, page, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == begin) {
+      return out->publishes != 0 ? DET_OK : DET_ERR_NOT_INITIALIZED;
+    }
+  }
+  return DET_ERR_BUSY;
+}
@@ -0,0 +1,11 @@
+#include <detalloc.h>
+
+/* ========================================================================== */
+/* Thread-Local Default Allocator                                             */
+/* ========================================================================== */
+DET_TLS det_allocator_t *det_tls_allocator;
+
+det_error_t det_thread_bind(det_allocator_t *alloc) {
+  det_tls_allocator = alloc;
+  return DET_OK;
+}
@@ -0,0 +1,115 @@
+/* calib.c - request-size calibration, det_calib_plan() and det_freeze()
+ *
+ * A warm-up window with up to 10 live 24-byte and 4 live 100-byte requests
+ * must plan one class per size (rounded up to its histogram bucket) sized
+ * at the peak plus 25% headroom. After det_freeze() requests come from the
+ * frozen arena, and warm-up blocks still go back to the fallback engine.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+  int allocs;
+  int frees;
+} engine_t;
+
+static void *engine_alloc(void *user, size_t size) {
+  ((engine_t *)user)->allocs++;
+  return malloc(size);
+}
+
+static void engine_free(void *user, void *ptr) {
+  ((engine_t *)user)->frees++;
+  free(ptr);
+}
+
+int main(void) {
+  det_calib_config_t cc = det_calib_default_config();
+  static unsigned char cal_mem[1 << 16];
+  det_allocator_t *frozen;
+  det_calib_t *cal;
+  det_config_t plan;
+  engine_t engine = {0, 0};
+  void *small[10];
+  void *big[4];
+  void *kept;
+  void *p;
+  size_t size;
+  void *arena;
+  int i;
+
+  CHECK(det_calib_size() <= sizeof(cal_mem));
+  cc.max_classes = 2;
+  cc.fallback_alloc = engine_alloc;
+  cc.fallback_free = engine_free;
+  cc.fallback_user = &engine;
+  cal = det_calib_init(cal_mem, sizeof(cal_mem), &cc);
+  CHECK(cal != NULL);
+  if (cal == NULL) {
+    return DET_TEST_DONE("calib");
+  }
+  CHECK(det_calib_plan(cal, &plan) == DET_ERR_INVALID_PARAM);
+
+  /* Two rounds so the peaks, not the request totals, size the classes. */
+  for (i = 0; i < 10; i++) {
+    small[i] = det_calib_alloc(cal, 24);
+  }
+  for (i = 0; i < 4; i++) {
+    big[i] = det_calib_alloc(cal, 100);
+  }
+  for (i = 0; i < 10; i++) {
+    det_calib_free(cal, small[i]);
+  }
+  for (i = 0; i < 4; i++) {
+    det_calib_free(cal, big[i]);
+  }
+  for (i = 0; i < 5; i++) {
+    small[i] = det_calib_alloc(cal, 20);
+  }
+  for (i = 0; i < 5; i++) {
+    det_calib_free(cal, small[i]);
+  }
+  kept = det_calib_alloc(cal, 24);
+  CHECK(engine.allocs == 20 && engine.frees == 19);
+
+  CHECK(det_calib_plan(cal, &plan) == DET_OK);
+  CHECK(plan.num_classes == 2);
+  CHECK(plan.classes[0].block_size == 24 && plan.classes[0].num_blocks == 13);
+  CHECK(plan.classes[1].block_size == 112 && plan.classes[1].num_blocks == 5);
+
+  size = det_alloc_size(&plan);
+  arena = malloc(size);
+  frozen = det_freeze(cal, arena, size);
+  CHECK(frozen != NULL);
+  if (frozen == NULL) {
+    return DET_TEST_DONE("calib");
+  }
+  CHECK(det_freeze(cal, arena, size) == NULL);
+
+  /* Frozen: pool blocks inside the arena, nothing from the engine, and
+   * no class above 112 bytes. */
+  p = det_calib_alloc(cal, 100);
+  CHECK(p != NULL && (uintptr_t)p >= (uintptr_t)arena &&
+        (uintptr_t)p < (uintptr_t)arena + size);
+  CHECK(det_alloc_usable_size(frozen, p) == 112);
+  CHECK(det_calib_alloc(cal, 113) == NULL);
+  CHECK(engine.allocs == 20);
+  for (i = 0; i < 13; i++) {
+    small[i % 10] = det_calib_alloc(cal, 24);
+    CHECK(small[i % 10] != NULL);
+  }
+  det_calib_free(cal, p);
+  CHECK(engine.frees == 19);
+
+  /* The block from before the freeze returns to the engine. */
+  det_calib_free(cal, kept);
+  CHECK(engine.frees == 20);
+
+  det_alloc_destroy(frozen);
+  free(arena);
+  return DET_TEST_DONE("calib");
+}
@@ -0,0 +1,119 @@
+/* classes.c - size-class routing and the max_spill bound
+ *
+ * Four ANY classes of 4 blocks (32..256 bytes) and one LONG class. A full
+ * class may spill to at most max_spill larger classes of its own lifetime
+ * group and never into another group; every spill is counted on both ends.
+ * DET_NEW_ARRAY() refuses a count whose byte size would wrap.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PER_CLASS 4
+
+static const det_class_config_t classes[] = {
+    {32, PER_CLASS, DET_LIFETIME_ANY, 0},
+    {64, PER_CLASS, DET_LIFETIME_ANY, 0},
+    {128, PER_CLASS, DET_LIFETIME_ANY, 0},
+    {256, PER_CLASS, DET_LIFETIME_ANY, 0},
+    {512, PER_CLASS, DET_LIFETIME_LONG, 0}};
+
+static det_allocator_t *make(size_t max_spill, void **mem) {
+  det_config_t cfg = det_default_config();
+  size_t size;
+
+  cfg.classes = classes;
+  cfg.num_classes = sizeof(classes) / sizeof(classes[0]);
+  cfg.max_spill = max_spill;
+  size = det_alloc_size(&cfg);
+  *mem = malloc(size);
+  return *mem == NULL ? NULL : det_alloc_init(*mem, size, &cfg);
+}
+
+/* Allocates @p size until NULL; returns how many blocks came from each
+ * class (by usable size) in @p per_class and the total. */
+static size_t drain(det_allocator_t *det, size_t size, size_t *per_class) {
+  size_t total = 0;
+  void *p;
+  size_t i;
+
+  for (i = 0; i < 5; i++) {
+    per_class[i] = 0;
+  }
+  while ((p = det_alloc_sized(det, size)) != NULL) {
+    size_t usable = det_alloc_usable_size(det, p);
+
+    for (i = 0; i < 5; i++) {
+      per_class[i] += usable == classes[i].block_size;
+    }
+    total++;
+  }
+  return total;
+}
+
+int main(void) {
+  det_allocator_t *det;
+  det_stats_t stats;
+  size_t got[5];
+  void *mem;
+
+  /* Exact fit first, then one larger class, then NULL. */
+  det = make(1, &mem);
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("classes");
+  }
+  CHECK(det_alloc_sized(det, 257) == NULL);
+  CHECK(drain(det, 20, got) == 2 * PER_CLASS);
+  CHECK(got[0] == PER_CLASS && got[1] == PER_CLASS && got[2] == 0);
+  det_get_stats(det, &stats);
+  CHECK(stats.spilled == PER_CLASS);
+  CHECK(stats.pool_stats[0].spilled_out == PER_CLASS);
+  CHECK(stats.pool_stats[0].failures == 1);
+  CHECK(stats.pool_stats[1].spilled_in == PER_CLASS);
+
+  /* 64-byte requests find their class full and take the next one only. */
+  CHECK(drain(det, 64, got) == PER_CLASS);
+  CHECK(got[2] == PER_CLASS && got[3] == 0);
+  det_alloc_destroy(det);
+  free(mem);
+
+  /* No spill at all. */
+  det = make(0, &mem);
+  CHECK(det != NULL && drain(det, 1, got) == PER_CLASS);
+  CHECK(got[0] == PER_CLASS);
+  det_alloc_destroy(det);
+  free(mem);
+
+  /* An array whose byte count wraps is refused, not served small. */
+  det = make(0, &mem);
+  CHECK(det != NULL);
+  if (det != NULL) {
+    uint64_t *a = DET_NEW_ARRAY(det, uint64_t, 4);
+
+    CHECK(a != NULL);
+    CHECK(DET_NEW_ARRAY(det, uint64_t, SIZE_MAX / 8 + 2) == NULL);
+    det_get_stats(det, &stats);
+    CHECK(stats.pool_stats[0].in_use == 1);
+    CHECK(stats.pool_stats[0].failures == 0);
+    det_alloc_destroy(det);
+  }
+  free(mem);
+
+  /* A large bound is clamped to the group: the whole ANY group is used,
+   * the LONG class is not. */
+  det = make(100, &mem);
+  CHECK(det != NULL && drain(det, 1, got) == 4 * PER_CLASS);
+  CHECK(got[0] == PER_CLASS && got[3] == PER_CLASS && got[4] == 0);
+  CHECK(det_alloc_hint(det, 1, DET_LIFETIME_LONG) != NULL);
+  det_get_stats(det, &stats);
+  CHECK(stats.pool_stats[4].in_use == 1);
+  CHECK(stats.pool_stats[4].lifetime == DET_LIFETIME_LONG);
+  det_alloc_destroy(det);
+  free(mem);
+
+  return DET_TEST_DONE("classes");
+}
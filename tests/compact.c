@@ -0,0 +1,207 @@
+/* compact.c - det_compact() in bounded steps, interleaved with allocation
+ *
+ * 8192 handle blocks of 64 bytes, each stamped with its index; two of
+ * every three below 4096 and the top quarter are freed. Allocations and
+ * frees between single-unit steps of a pass must neither hand out a live
+ * block nor lose one: once the pass returns DET_OK, exactly the free
+ * blocks can be allocated again. A pass abandoned after its first move
+ * must not lose the block it moved away from either. A step settles at
+ * most 512 blocks, so even a pass with nothing to move takes a step per
+ * 512 blocks for each of its two settles.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCKS 8192
+#define BLOCK 64
+#define RING 16
+
+static det_handle_t h[BLOCKS];
+static void *drained[BLOCKS];
+
+static int live(int i) {
+  return i < BLOCKS * 3 / 4 && (i >= BLOCKS / 2 || i % 3 == 0);
+}
+
+static det_allocator_t *setup(void *mem, size_t size, size_t *nlive) {
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  int i;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.num_handles = BLOCKS;
+  cfg.thread_safe = true;
+  det = det_alloc_init(mem, size, &cfg);
+  if (det == NULL) {
+    return NULL;
+  }
+  *nlive = 0;
+  for (i = 0; i < BLOCKS; i++) {
+    h[i] = det_handle_alloc(det, BLOCK);
+    if (h[i] == DET_HANDLE_NULL) {
+      return NULL;
+    }
+    memset(det_handle_get(det, h[i]), i & 0xFF, BLOCK);
+  }
+  for (i = 0; i < BLOCKS; i++) {
+    if (live(i)) {
+      (*nlive)++;
+    } else {
+      det_handle_free(det, h[i]);
+    }
+  }
+  return det;
+}
+
+static int contents_ok(det_allocator_t *det) {
+  int i;
+
+  for (i = 0; i < BLOCKS; i++) {
+    const unsigned char *p;
+
+    if (!live(i)) {
+      continue;
+    }
+    p = det_handle_get(det, h[i]);
+    if (p == NULL || p[0] != (unsigned char)i ||
+        p[BLOCK - 1] != (unsigned char)i) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Allocates until the pool runs dry, scribbling over every block. */
+static size_t drain(det_allocator_t *det) {
+  size_t n = 0;
+
+  while (n < BLOCKS && (drained[n] = det_alloc(det)) != NULL) {
+    memset(drained[n], 0xEE, BLOCK);
+    n++;
+  }
+  return n;
+}
+
+static void undrain(det_allocator_t *det, size_t n) {
+  while (n-- > 0) {
+    det_free(det, drained[n]);
+  }
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+  unsigned char *moved_from;
+  void *ring[RING];
+  det_allocator_t *det;
+  det_error_t err;
+  size_t nlive;
+  size_t calls;
+  size_t size;
+  size_t k;
+  void *mem;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.num_handles = BLOCKS;
+  cfg.thread_safe = true;
+  size = det_alloc_size(&cfg);
+  mem = malloc(size);
+  det = mem != NULL ? setup(mem, size, &nlive) : NULL;
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("compact");
+  }
+
+  /* One unit per call, with allocations and frees in between. */
+  memset(ring, 0, sizeof(ring));
+  calls = 0;
+  do {
+    uint64_t *p = ring[calls % RING];
+
+    err = det_compact(det, 1);
+    if (p != NULL) {
+      CHECK(p[0] == calls % RING && p[BLOCK / 8 - 1] == calls % RING);
+      det_free(det, p);
+    }
+    p = det_alloc(det);
+    CHECK(p != NULL);
+    if (p != NULL) {
+      p[0] = calls % RING;
+      p[BLOCK / 8 - 1] = calls % RING;
+    }
+    ring[calls % RING] = p;
+    calls++;
+  } while (err == DET_ERR_BUSY && calls < 100000);
+  CHECK(err == DET_OK);
+  CHECK(contents_ok(det));
+  for (k = 0; k < RING; k++) {
+    det_free(det, ring[k]);
+  }
+  k = drain(det);
+  CHECK(k == BLOCKS - nlive);
+  CHECK(contents_ok(det));
+  undrain(det, k);
+  det_alloc_destroy(det);
+
+  /* Abandoned after the first move: the source block is still reusable. */
+  det = setup(mem, size, &nlive);
+  CHECK(det != NULL);
+  if (det == NULL) {
+    free(mem);
+    return DET_TEST_DONE("compact");
+  }
+  moved_from = det_handle_get(det, h[BLOCKS * 3 / 4 - 1]);
+  calls = 0;
+  do {
+    err = det_compact(det, 1);
+  } while (err == DET_ERR_BUSY &&
+           det_handle_get(det, h[BLOCKS * 3 / 4 - 1]) == moved_from &&
+           ++calls < 100000);
+  CHECK(err == DET_ERR_BUSY);
+  CHECK(det_handle_get(det, h[BLOCKS * 3 / 4 - 1]) != moved_from);
+  CHECK(contents_ok(det));
+  k = drain(det);
+  CHECK(k == BLOCKS - nlive);
+  CHECK(contents_ok(det));
+  undrain(det, k);
+
+  /* Resumed later, the pass still completes. */
+  calls = 0;
+  do {
+    err = det_compact(det, 64);
+  } while (err == DET_ERR_BUSY && ++calls < 100000);
+  CHECK(err == DET_OK);
+  CHECK(contents_ok(det));
+  k = drain(det);
+  CHECK(k == BLOCKS - nlive);
+  undrain(det, k);
+  det_alloc_destroy(det);
+
+  /* Without handle blocks nothing moves; the settles before and after
+   * still take a step per 512 blocks each. */
+  det = det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det != NULL) {
+    CHECK(drain(det) == BLOCKS);
+    for (k = 0; k < BLOCKS; k += 2) {
+      det_free(det, drained[k]);
+    }
+    calls = 0;
+    do {
+      err = det_compact(det, 1);
+    } while (err == DET_ERR_BUSY && ++calls < 100000);
+    CHECK(err == DET_OK);
+    CHECK(calls >= 2 * BLOCKS / 512);
+    k = drain(det);
+    CHECK(k == BLOCKS / 2);
+    det_alloc_destroy(det);
+  }
+  free(mem);
+  return DET_TEST_DONE("compact");
+}
@@ -0,0 +1,26 @@
+/* det_test.h - minimal check macros shared by the unit tests
+ *
+ * Each test is a standalone program: CHECK() reports a failed condition
+ * with its location and keeps going, DET_TEST_DONE() prints the verdict
+ * and yields the exit status for `make test`.
+ */
+#ifndef DET_TEST_H
+#define DET_TEST_H
+
+#include <stdio.h>
+
+static int det_test_failures;
+
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);        \
+      det_test_failures++;                                                    \
+    }                                                                         \
+  } while (0)
+
+#define DET_TEST_DONE(name)                                                   \
+  (printf("%s: %s\n", (name), det_test_failures ? "FAIL" : "ok"),             \
+   det_test_failures != 0)
+
+#endif /* DET_TEST_H */
@@ -0,0 +1,150 @@
+/* frame_region.c - DET_LIFETIME_FRAME requests and det_frame_reset()
+ *
+ * A 1 KiB frame region with 16-byte alignment, in plain, thread_safe and
+ * signal_safe mode. Frame requests are bumped back to back at the
+ * allocator's alignment, a zero-byte request still takes one unit, and a
+ * request that does not fit fails without moving the bump, counted in
+ * frame_failures. det_free() ignores frame blocks. det_frame_reset() only
+ * rewinds the bump: the region's bytes are left as they were, the next
+ * request gets the first block again and frame_peak keeps the high-water
+ * mark. Without a frame region the same requests go to the pools.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN 16
+#define FRAME 1024
+#define BLOCK 64
+#define BLOCKS 16
+
+static size_t round_up(size_t n) {
+  return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+static det_config_t frame_config(int mode) {
+  det_config_t cfg = det_default_config();
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.align = ALIGN;
+  cfg.frame_size = FRAME;
+  cfg.thread_safe = mode == 1;
+  cfg.signal_safe = mode == 2;
+  return cfg;
+}
+
+static void run(det_allocator_t *det) {
+  static const size_t sizes[] = {1, 16, 17, 0, 100, 3, 64};
+  static det_stats_t stats;
+  unsigned char *first;
+  unsigned char *p;
+  size_t used;
+  size_t i;
+
+  first = det_alloc_hint(det, sizes[0], DET_LIFETIME_FRAME);
+  CHECK(first != NULL && (uintptr_t)first % ALIGN == 0);
+  if (first == NULL) {
+    return;
+  }
+  used = round_up(sizes[0]);
+  for (i = 1; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    p = det_alloc_hint(det, sizes[i], DET_LIFETIME_FRAME);
+    CHECK(p == first + used);
+    CHECK(p != NULL && (uintptr_t)p % ALIGN == 0);
+    used += round_up(sizes[i] != 0 ? sizes[i] : 1);
+  }
+  det_get_stats(det, &stats);
+  CHECK(stats.frame_size == FRAME);
+  CHECK(stats.frame_used == used);
+  CHECK(stats.frame_peak == used);
+  CHECK(stats.frame_failures == 0);
+  CHECK(stats.pool_stats[0].in_use == 0);
+
+  /* Too big for what is left, and too big for the region at all. */
+  CHECK(det_alloc_hint(det, FRAME - used + 1, DET_LIFETIME_FRAME) == NULL);
+  CHECK(det_alloc_hint(det, FRAME + 1, DET_LIFETIME_FRAME) == NULL);
+  CHECK(det_alloc_hint(det, SIZE_MAX, DET_LIFETIME_FRAME) == NULL);
+  p = det_alloc_hint(det, FRAME - used, DET_LIFETIME_FRAME);
+  CHECK(p == first + used);
+  CHECK(det_alloc_hint(det, 0, DET_LIFETIME_FRAME) == NULL);
+  det_get_stats(det, &stats);
+  CHECK(stats.frame_used == FRAME);
+  CHECK(stats.frame_peak == FRAME);
+  CHECK(stats.frame_failures == 4);
+
+  /* Frame blocks are not the pools' to free. */
+  memset(first, 0xA5, FRAME);
+  det_free(det, first);
+  det_free(det, p);
+  det_get_stats(det, &stats);
+  CHECK(stats.pool_stats[0].frees == 0);
+  CHECK(stats.frame_used == FRAME);
+
+  /* Reset rewinds the bump and nothing else. */
+  det_frame_reset(det);
+  det_get_stats(det, &stats);
+  CHECK(stats.frame_used == 0);
+  CHECK(stats.frame_peak == FRAME);
+  CHECK(first[0] == 0xA5 && first[FRAME - 1] == 0xA5);
+  p = det_alloc_hint(det, 40, DET_LIFETIME_FRAME);
+  CHECK(p == first);
+  det_get_stats(det, &stats);
+  CHECK(stats.frame_used == round_up(40));
+  CHECK(stats.frame_peak == FRAME);
+  CHECK(stats.frame_failures == 4);
+  det_frame_reset(det);
+}
+
+int main(void) {
+  static det_stats_t stats;
+  det_config_t cfg;
+  det_allocator_t *det;
+  size_t size = 0;
+  void *mem;
+  void *p;
+  int mode;
+
+  for (mode = 0; mode < 3; mode++) {
+    cfg = frame_config(mode);
+    if (det_alloc_size(&cfg) > size) {
+      size = det_alloc_size(&cfg);
+    }
+  }
+  mem = malloc(size);
+  CHECK(mem != NULL);
+  if (mem == NULL) {
+    return DET_TEST_DONE("frame_region");
+  }
+
+  for (mode = 0; mode < 3; mode++) {
+    cfg = frame_config(mode);
+    det = det_alloc_init(mem, size, &cfg);
+    CHECK(det != NULL);
+    if (det != NULL) {
+      run(det);
+      det_alloc_destroy(det);
+    }
+  }
+
+  /* No frame region: served by the pools like any short-lived request. */
+  cfg = frame_config(0);
+  cfg.frame_size = 0;
+  det = det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det != NULL) {
+    p = det_alloc_hint(det, 10, DET_LIFETIME_FRAME);
+    CHECK(p != NULL);
+    det_get_stats(det, &stats);
+    CHECK(stats.frame_size == 0);
+    CHECK(stats.pool_stats[0].in_use == 1);
+    det_free(det, p);
+    det_alloc_destroy(det);
+  }
+  free(mem);
+  return DET_TEST_DONE("frame_region");
+}
@@ -0,0 +1,100 @@
+/* guard.c - guard_pages: overflows out of page-sized blocks fault
+ *
+ * Every block of a 4096- and a 5000-byte class must be writable up to its
+ * last byte, and the first byte past it must raise SIGSEGV. Each overflow
+ * runs in a forked child with its own SIGSEGV handler (the sanitizers
+ * install one too), so the parent only reads the exit status. Skipped in
+ * builds where guard pages are inactive (NDEBUG, no mprotect()).
+ */
+#define _DEFAULT_SOURCE
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PER_CLASS 4
+#define FAULTED 42
+
+static const det_class_config_t classes[] = {
+    {4096, PER_CLASS, DET_LIFETIME_ANY, 0},
+    {5000, PER_CLASS, DET_LIFETIME_ANY, 0}};
+
+static volatile sig_atomic_t past_end;
+
+/* Only a fault on the byte past the block counts. */
+static void on_segv(int sig) {
+  (void)sig;
+  _exit(past_end ? FAULTED : 1);
+}
+
+/* Writes @p p[0..len) in a child, then one byte more; the child's status
+ * says whether the extra byte faulted. */
+static int overflow_faults(unsigned char *p, size_t len) {
+  struct sigaction sa;
+  int status;
+  pid_t pid;
+
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0) {
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_segv;
+    sigaction(SIGSEGV, &sa, NULL);
+    memset(p, 0x33, len);
+    past_end = 1;
+    *(volatile unsigned char *)(p + len) = 0x33;
+    _exit(0);
+  }
+  return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+         WEXITSTATUS(status) == FAULTED;
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  unsigned char *p;
+  size_t plain;
+  size_t size;
+  size_t c;
+  void *mem;
+  int i;
+
+  cfg.classes = classes;
+  cfg.num_classes = 2;
+  plain = det_alloc_size(&cfg);
+  cfg.guard_pages = true;
+  size = det_alloc_size(&cfg);
+  if (size == plain) {
+    printf("guard: skipped (guard pages inactive in this build)\n");
+    return 0;
+  }
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  det = mem != MAP_FAILED ? det_alloc_init(mem, size, &cfg) : NULL;
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("guard");
+  }
+
+  for (c = 0; c < 2; c++) {
+    for (i = 0; i < PER_CLASS; i++) {
+      p = det_alloc_sized(det, classes[c].block_size);
+      CHECK(p != NULL);
+      if (p != NULL) {
+        CHECK(overflow_faults(p, classes[c].block_size));
+      }
+    }
+  }
+
+  /* Destroy hands the buffer back fully writable. */
+  det_alloc_destroy(det);
+  memset(mem, 0, size);
+  munmap(mem, size);
+  return DET_TEST_DONE("guard");
+}
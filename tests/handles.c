@@ -0,0 +1,152 @@
+/* handles.c - handles, det_compact() and det_trim()
+ *
+ * 128 handle blocks of 256 bytes in an mmap'ed arena, each stamped with
+ * its index. Freeing the even ones below 64 and all of 64..95 leaves
+ * holes; compaction must pack the 63 unpinned blocks into the lowest
+ * slots without changing what the handles read, leave a pinned block
+ * where it is, and lower the high-water index so det_trim() can release
+ * the tail.
+ */
+#define _DEFAULT_SOURCE
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define BLOCKS 128
+#define BLOCK 256
+
+static det_handle_t h[BLOCKS];
+
+static int live(int i) { return (i < 64 && i % 2 == 1) || i >= 96; }
+
+/* Every live handle still reads its stamp. */
+static int contents_ok(det_allocator_t *det) {
+  unsigned char buf[BLOCK];
+  int i;
+
+  for (i = 0; i < BLOCKS; i++) {
+    const unsigned char *p;
+
+    if (!live(i)) {
+      continue;
+    }
+    p = det_handle_get(det, h[i]);
+    if (p == NULL || p[0] != (unsigned char)i ||
+        p[BLOCK - 1] != (unsigned char)i ||
+        det_handle_read(det, h[i], buf, BLOCK) != DET_OK ||
+        memcmp(buf, p, BLOCK) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void compact_all(det_allocator_t *det) {
+  det_error_t err;
+  int rounds = 0;
+
+  do {
+    err = det_compact(det, 1);
+  } while (err == DET_ERR_BUSY && ++rounds < 10000);
+  CHECK(err == DET_OK);
+}
+
+/* Index of @p h's block relative to @p base. */
+static size_t index_of(det_allocator_t *det, det_handle_t hd,
+                       const unsigned char *base) {
+  return (size_t)((const unsigned char *)det_handle_get(det, hd) - base) /
+         BLOCK;
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  unsigned char *base;
+  unsigned char *pinned;
+  det_handle_t stale;
+  size_t size;
+  size_t released;
+  void *mem;
+  int i;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.num_handles = BLOCKS;
+  size = det_alloc_size(&cfg);
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  CHECK(mem != MAP_FAILED);
+  det = mem == MAP_FAILED ? NULL : det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("handles");
+  }
+
+  for (i = 0; i < BLOCKS; i++) {
+    h[i] = det_handle_alloc(det, BLOCK);
+    CHECK(h[i] != DET_HANDLE_NULL);
+    memset(det_handle_get(det, h[i]), i, BLOCK);
+  }
+  CHECK(det_handle_alloc(det, 1) == DET_HANDLE_NULL);
+  base = det_handle_get(det, h[0]);
+  CHECK(index_of(det, h[BLOCKS - 1], base) == BLOCKS - 1);
+  for (i = 0; i < BLOCKS; i++) {
+    if (!live(i)) {
+      det_handle_free(det, h[i]);
+    }
+  }
+  CHECK(det_trim(det) == 0);
+
+  /* Freed handles go stale, also once their slot is reused. */
+  stale = h[0];
+  CHECK(det_handle_get(det, stale) == NULL);
+  h[0] = det_handle_alloc(det, 1);
+  CHECK(h[0] != DET_HANDLE_NULL && det_handle_get(det, stale) == NULL);
+  det_handle_free(det, stale);
+  CHECK(det_handle_get(det, h[0]) != NULL);
+  det_handle_free(det, h[0]);
+
+  /* Compaction around a pinned block. */
+  pinned = det_handle_pin(det, h[96]);
+  CHECK(pinned == base + 96 * BLOCK);
+  compact_all(det);
+  CHECK(det_handle_get(det, h[96]) == pinned);
+  CHECK(contents_ok(det));
+  for (i = 0; i < BLOCKS; i++) {
+    CHECK(!live(i) || i == 96 || index_of(det, h[i], base) < 63);
+  }
+  released = det_trim(det);
+  CHECK(released > 0);
+  CHECK(contents_ok(det));
+
+  /* Unpinned, the last outlier moves down too and more can be trimmed. */
+  det_handle_unpin(det, h[96]);
+  compact_all(det);
+  CHECK(index_of(det, h[96], base) < 64);
+  CHECK(contents_ok(det));
+  CHECK(det_trim(det) > 0);
+
+  /* Released pages come back zeroed and usable. */
+  for (i = 0; i < BLOCKS; i++) {
+    if (!live(i)) {
+      unsigned char *p;
+
+      h[i] = det_handle_alloc(det, BLOCK);
+      p = det_handle_get(det, h[i]);
+      CHECK(p != NULL);
+      if (p != NULL) {
+        memset(p, i, BLOCK);
+      }
+    }
+  }
+  CHECK(det_handle_alloc(det, 1) == DET_HANDLE_NULL);
+
+  det_alloc_destroy(det);
+  munmap(mem, size);
+  return DET_TEST_DONE("handles");
+}
@@ -0,0 +1,117 @@
+/* layout.c - per-class alignment and payload_align
+ *
+ * Every block must be aligned to its class's align (or config.align when
+ * that is 0; tiny classes to their power-of-two size), consecutive blocks
+ * must be one rounded-up stride apart, and with payload_align each class's
+ * first block must start on that boundary, whatever the alignment of the
+ * buffer passed in.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PER_CLASS 8
+
+static const det_class_config_t classes[] = {
+    {3, PER_CLASS, DET_LIFETIME_ANY, 0},  /* tiny: packed at 4 */
+    {24, PER_CLASS, DET_LIFETIME_ANY, 0}, /* config align */
+    {100, PER_CLASS, DET_LIFETIME_ANY, 128},
+    {2, PER_CLASS, DET_LIFETIME_LONG, 8}, /* tiny, spread to 8 */
+    {64, PER_CLASS, DET_LIFETIME_LONG, 64},
+    {5000, PER_CLASS, DET_LIFETIME_LONG, 4096}};
+
+#define NUM_CLASSES (sizeof(classes) / sizeof(classes[0]))
+
+static size_t class_align(size_t c, size_t config_align) {
+  size_t tiny = 1;
+
+  if (classes[c].block_size <= sizeof(void *) / 2) {
+    while (tiny < classes[c].block_size) {
+      tiny <<= 1;
+    }
+    return classes[c].align > tiny ? classes[c].align : tiny;
+  }
+  return classes[c].align != 0 ? classes[c].align : config_align;
+}
+
+/* Checks every block of every class and, unless @p payload_align is 0,
+ * that each class's first block sits on it. */
+static void check(det_allocator_t *det, size_t config_align,
+                  size_t payload_align) {
+  size_t c;
+  int i;
+
+  for (c = 0; c < NUM_CLASSES; c++) {
+    size_t a = class_align(c, config_align);
+    size_t stride = (classes[c].block_size + a - 1) / a * a;
+    det_lifetime_t lt = classes[c].lifetime;
+    uintptr_t first = 0;
+    uintptr_t prev = 0;
+
+    for (i = 0; i < PER_CLASS; i++) {
+      uintptr_t p = (uintptr_t)det_alloc_hint(det, classes[c].block_size, lt);
+
+      CHECK(p != 0 && p % a == 0);
+      CHECK(det_alloc_usable_size(det, (void *)p) >= classes[c].block_size);
+      if (i == 0) {
+        first = p;
+      } else {
+        CHECK(p == prev + stride);
+      }
+      prev = p;
+    }
+    if (payload_align != 0) {
+      CHECK(first % payload_align == 0);
+    }
+  }
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  unsigned char *raw;
+  size_t size;
+  size_t shift;
+
+  cfg.classes = classes;
+  cfg.num_classes = NUM_CLASSES;
+  cfg.align = 16;
+
+  /* Class alignment alone, at several buffer misalignments. */
+  size = det_alloc_size(&cfg);
+  CHECK(size != 0);
+  raw = malloc(size + 64);
+  for (shift = 0; shift < 64; shift += 8) {
+    det = det_alloc_init(raw + shift, size, &cfg);
+    CHECK(det != NULL);
+    if (det != NULL) {
+      check(det, 16, 0);
+      det_alloc_destroy(det);
+    }
+  }
+  free(raw);
+
+  /* Page-aligned payload regions, also from an odd buffer. */
+  cfg.payload_align = 4096;
+  size = det_alloc_size(&cfg);
+  raw = malloc(size + 8);
+  det = det_alloc_init(raw + 8, size, &cfg);
+  CHECK(det != NULL);
+  if (det != NULL) {
+    check(det, 16, 4096);
+    det_alloc_destroy(det);
+  }
+  free(raw);
+
+  /* Invalid alignments are rejected. */
+  cfg.payload_align = 3000;
+  CHECK(det_alloc_size(&cfg) == 0);
+  cfg.payload_align = 0;
+  cfg.align = 24;
+  CHECK(det_alloc_size(&cfg) == 0);
+
+  return DET_TEST_DONE("layout");
+}
@@ -0,0 +1,146 @@
+/* lifetime.c - per-class alloc-to-free histograms (track_lifetime)
+ *
+ * Every free adds exactly one sample, binned by floor(log2) of the
+ * det_get_cycles() ticks the block lived: the bin must lie between those
+ * of the shortest and longest age the caller could have observed. Blocks
+ * kept for about 2^12 and 2^22 ticks land in different bins. Without
+ * track_lifetime, or in a build without RT_ALLOC_LIFETIME (run again as
+ * test_lifetime_off), the birth stamps take no memory and nothing is
+ * recorded.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BLOCK 64
+#define BLOCKS 256
+
+static uint64_t samples(const det_pool_stats_t *ps) {
+  uint64_t total = 0;
+  unsigned b;
+
+  for (b = 0; b < DET_LIFETIME_BUCKETS; b++) {
+    total += ps->lifetime_hist[b];
+  }
+  return total;
+}
+
+#if defined(RT_ALLOC_LIFETIME)
+static unsigned bin_of(uint64_t ticks) {
+  unsigned bin = 0;
+
+  while (ticks > 1 && bin < DET_LIFETIME_BUCKETS - 1) {
+    ticks >>= 1;
+    bin++;
+  }
+  return bin;
+}
+
+/* Keeps one block for at least @p hold ticks; returns the bin its free
+ * recorded, or DET_LIFETIME_BUCKETS unless that was exactly one sample in
+ * a bin the observed ages allow. */
+static unsigned hold_one(det_allocator_t *det, uint64_t hold) {
+  static det_stats_t before;
+  static det_stats_t after;
+  unsigned bin = DET_LIFETIME_BUCKETS;
+  unsigned b;
+  uint64_t t0;
+  uint64_t t1;
+  uint64_t t2;
+  uint64_t t3;
+  void *p;
+
+  det_get_stats(det, &before);
+  t0 = det_get_cycles();
+  p = det_alloc(det);
+  t1 = det_get_cycles();
+  if (p == NULL) {
+    return DET_LIFETIME_BUCKETS;
+  }
+  do {
+    t2 = det_get_cycles();
+  } while (t2 - t1 < hold);
+  det_free(det, p);
+  t3 = det_get_cycles();
+  det_get_stats(det, &after);
+  if (samples(&after.pool_stats[0]) != samples(&before.pool_stats[0]) + 1) {
+    return DET_LIFETIME_BUCKETS;
+  }
+  for (b = 0; b < DET_LIFETIME_BUCKETS; b++) {
+    if (after.pool_stats[0].lifetime_hist[b] !=
+        before.pool_stats[0].lifetime_hist[b]) {
+      bin = b;
+    }
+  }
+  return bin >= bin_of(t2 - t1) && bin <= bin_of(t3 - t0)
+             ? bin
+             : DET_LIFETIME_BUCKETS;
+}
+#endif
+
+int main(void) {
+  static det_stats_t stats;
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+#if defined(RT_ALLOC_LIFETIME)
+  unsigned short_bin;
+  unsigned long_bin;
+#endif
+  size_t plain;
+  size_t size;
+  void *mem;
+  void *p;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  plain = det_alloc_size(&cfg);
+  cfg.track_lifetime = true;
+  size = det_alloc_size(&cfg);
+#if defined(RT_ALLOC_LIFETIME)
+  CHECK(size >= plain + BLOCKS * sizeof(uint64_t));
+#else
+  CHECK(size == plain);
+#endif
+  mem = malloc(size);
+  det = mem != NULL ? det_alloc_init(mem, size, &cfg) : NULL;
+  CHECK(det != NULL);
+  if (det == NULL) {
+    free(mem);
+    return DET_TEST_DONE("lifetime");
+  }
+
+#if defined(RT_ALLOC_LIFETIME)
+  short_bin = hold_one(det, (uint64_t)1 << 12);
+  long_bin = hold_one(det, (uint64_t)1 << 22);
+  CHECK(short_bin < DET_LIFETIME_BUCKETS);
+  CHECK(long_bin < DET_LIFETIME_BUCKETS);
+  CHECK(long_bin > short_bin);
+  det_get_stats(det, &stats);
+  CHECK(samples(&stats.pool_stats[0]) == 2);
+  CHECK(stats.pool_stats[0].lifetime_hist[short_bin] == 1);
+  CHECK(stats.pool_stats[0].lifetime_hist[long_bin] == 1);
+#else
+  p = det_alloc(det);
+  det_free(det, p);
+  det_get_stats(det, &stats);
+  CHECK(samples(&stats.pool_stats[0]) == 0);
+#endif
+  det_alloc_destroy(det);
+
+  /* Not asked for: no samples either way. */
+  cfg.track_lifetime = false;
+  det = det_alloc_init(mem, plain, &cfg);
+  CHECK(det != NULL);
+  if (det != NULL) {
+    p = det_alloc(det);
+    det_free(det, p);
+    det_get_stats(det, &stats);
+    CHECK(samples(&stats.pool_stats[0]) == 0);
+    det_alloc_destroy(det);
+  }
+  free(mem);
+  return DET_TEST_DONE("lifetime");
+}
@@ -0,0 +1,98 @@
+/* migrate.c - det_alloc_migrate() and det_alloc_relocate()
+ *
+ * A grown copy must keep every live block's contents at the same pool and
+ * index, reachable through det_alloc_relocate(). A migration that cannot
+ * fit must fail without leaving anything behind in the new buffer: with
+ * guard_pages its PROT_NONE pages would otherwise fault the caller.
+ */
+#define _DEFAULT_SOURCE
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BLOCKS 8
+
+static void *map(size_t size) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return p == MAP_FAILED ? NULL : p;
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+  det_config_t big;
+  det_config_t small;
+  det_allocator_t *det;
+  det_allocator_t *to;
+  unsigned char *blocks[BLOCKS];
+  size_t size;
+  size_t big_size;
+  size_t small_size;
+  void *mem;
+  void *big_mem;
+  void *small_mem;
+  int i;
+
+  cfg.block_size = (size_t)sysconf(_SC_PAGESIZE);
+  cfg.num_blocks = BLOCKS;
+  size = det_alloc_size(&cfg);
+  mem = map(size);
+  det = mem != NULL ? det_alloc_init(mem, size, &cfg) : NULL;
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("migrate");
+  }
+  for (i = 0; i < BLOCKS; i++) {
+    blocks[i] = det_alloc(det);
+    CHECK(blocks[i] != NULL);
+    memset(blocks[i], 'a' + i, cfg.block_size);
+  }
+  det_free(det, blocks[3]);
+
+  /* Too small, and guarded: NULL, and the new buffer is all writable. */
+  small = cfg;
+  small.num_blocks = BLOCKS / 2;
+  small.guard_pages = true;
+  small_size = det_alloc_size(&small);
+  small_mem = map(small_size);
+  CHECK(small_mem != NULL);
+  CHECK(det_alloc_migrate(det, small_mem, small_size, &small) == NULL);
+  memset(small_mem, 0, small_size);
+  munmap(small_mem, small_size);
+
+  /* Grown: same contents, same indices, old allocator untouched. */
+  big = cfg;
+  big.num_blocks = 4 * BLOCKS;
+  big_size = det_alloc_size(&big);
+  big_mem = map(big_size);
+  to = big_mem != NULL ? det_alloc_migrate(det, big_mem, big_size, &big)
+                       : NULL;
+  CHECK(to != NULL);
+  if (to != NULL) {
+    for (i = 0; i < BLOCKS; i++) {
+      unsigned char *p = det_alloc_relocate(det, to, blocks[i] + 5);
+
+      CHECK(p != NULL);
+      CHECK(p == NULL || i == 3 ||
+            (p[-5] == 'a' + i && p[cfg.block_size - 6] == 'a' + i));
+    }
+    /* The freed block and the new capacity are allocatable. */
+    for (i = 0; i < 3 * BLOCKS + 1; i++) {
+      CHECK(det_alloc(to) != NULL);
+    }
+    CHECK(det_alloc(to) == NULL);
+    det_alloc_destroy(to);
+  }
+  CHECK(blocks[0][0] == 'a');
+
+  det_alloc_destroy(det);
+  munmap(big_mem, big_size);
+  munmap(mem, size);
+  return DET_TEST_DONE("migrate");
+}
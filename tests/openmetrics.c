@@ -0,0 +1,157 @@
+/* openmetrics.c - det_stats_format_openmetrics() line format
+ *
+ * Every line must be a "# TYPE", "# HELP" or sample line, the document
+ * must end in "# EOF", counters carry _total, label values are escaped,
+ * and histogram buckets are cumulative with inclusive le = 2^(b+1) - 1
+ * bounds and +Inf equal to the number of observations.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static char doc[1 << 18];
+
+/* Value of the sample line that starts with @p prefix ("name{...} "),
+ * or -1. */
+static long long sample(const char *prefix) {
+  const char *line = doc;
+  size_t n = strlen(prefix);
+
+  while (*line != '\0') {
+    if (strncmp(line, prefix, n) == 0) {
+      return atoll(line + n);
+    }
+    line = strchr(line, '\n');
+    if (line == NULL) {
+      break;
+    }
+    line++;
+  }
+  return -1;
+}
+
+/* One line: a comment of the three known kinds or "name[{...}] value". */
+static int line_ok(const char *line, size_t len) {
+  const char *sp;
+  size_t i;
+
+  if (len >= 7 && (strncmp(line, "# TYPE ", 7) == 0 ||
+                   strncmp(line, "# HELP ", 7) == 0)) {
+    return 1;
+  }
+  if (len == 5 && strncmp(line, "# EOF", 5) == 0) {
+    return 1;
+  }
+  if (strncmp(line, "detalloc_", 9) != 0) {
+    return 0;
+  }
+  sp = line + len;
+  while (sp > line && sp[-1] != ' ') {
+    sp--;
+  }
+  if (sp == line || sp == line + len) {
+    return 0;
+  }
+  for (i = (size_t)(sp - line); i < len; i++) {
+    if (line[i] < '0' || line[i] > '9') {
+      return 0;
+    }
+  }
+  return sp[-2] == '}' || memchr(line, '{', len) == NULL;
+}
+
+int main(void) {
+  det_class_config_t classes[2] = {{64, 16, DET_LIFETIME_ANY, 0},
+                                   {256, 16, DET_LIFETIME_LONG, 0}};
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  const char *line;
+  const char *labels;
+  char small[64];
+  char key[256];
+  void *p[3];
+  long long prev = 0;
+  long long v;
+  size_t n;
+  size_t size;
+  void *mem;
+  int lines = 0;
+  unsigned b;
+
+  cfg.classes = classes;
+  cfg.num_classes = 2;
+  cfg.tenant = "a\"b\\c";
+  size = det_alloc_size(&cfg);
+  mem = malloc(size);
+  det = det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("openmetrics");
+  }
+  p[0] = det_alloc_sized(det, 10);
+  p[1] = det_alloc_sized(det, 10);
+  p[2] = det_alloc_sized(det, 10);
+  det_free(det, p[0]);
+
+  n = det_stats_format_openmetrics(det, doc, sizeof(doc));
+  CHECK(n != 0 && n == strlen(doc));
+  CHECK(n >= 6 && strcmp(doc + n - 6, "# EOF\n") == 0);
+  for (line = doc; *line != '\0'; lines++) {
+    const char *nl = strchr(line, '\n');
+
+    CHECK(nl != NULL);
+    if (nl == NULL) {
+      break;
+    }
+    if (!line_ok(line, (size_t)(nl - line))) {
+      printf("bad line: %.*s\n", (int)(nl - line), line);
+      CHECK(0);
+    }
+    line = nl + 1;
+  }
+  CHECK(lines > 100);
+
+  /* Labels in a fixed order, tenant escaped, counters with _total. */
+  labels = "{tenant=\"a\\\"b\\\\c\",pool=\"0\",block_size=\"64\","
+           "lifetime=\"any\"}";
+  snprintf(key, sizeof(key), "detalloc_pool_in_use%s ", labels);
+  CHECK(sample(key) == 2);
+  snprintf(key, sizeof(key), "detalloc_pool_allocs_total%s ", labels);
+  CHECK(sample(key) == 3);
+  snprintf(key, sizeof(key), "detalloc_pool_frees_total%s ", labels);
+  CHECK(sample(key) == 1);
+  CHECK(strstr(doc, "# TYPE detalloc_pool_frees counter\n") != NULL);
+  CHECK(strstr(doc, "lifetime=\"long\"") != NULL);
+
+  /* Buckets: le 1, 3, 7, ... cumulative up to +Inf = all allocations. */
+  CHECK(strstr(doc, "# TYPE detalloc_pool_alloc_latency_cycles "
+                    "histogram\n") != NULL);
+  CHECK(strstr(doc, "le=\"2\"") == NULL);
+  for (b = 0; b + 1 < DET_LATENCY_BUCKETS; b++) {
+    snprintf(key, sizeof(key),
+             "detalloc_pool_alloc_latency_cycles_bucket{tenant=\"a\\\"b\\\\c"
+             "\",pool=\"0\",block_size=\"64\",lifetime=\"any\",le=\"%llu\"} ",
+             (1ull << (b + 1)) - 1);
+    v = sample(key);
+    CHECK(v >= prev);
+    prev = v;
+  }
+  v = sample("detalloc_pool_alloc_latency_cycles_bucket{tenant=\"a\\\"b\\\\c"
+             "\",pool=\"0\",block_size=\"64\",lifetime=\"any\",le=\"+Inf\"} ");
+  CHECK(v >= prev);
+#if defined(RT_ALLOC_WCET) && !defined(RT_ALLOC_NO_STATS)
+  CHECK(v == 3);
+#endif
+
+  /* Too small: 0 and an empty string, never a truncated document. */
+  CHECK(det_stats_format_openmetrics(det, small, sizeof(small)) == 0);
+  CHECK(small[0] == '\0');
+  CHECK(det_stats_format_openmetrics(NULL, doc, sizeof(doc)) == 0);
+
+  det_alloc_destroy(det);
+  free(mem);
+  return DET_TEST_DONE("openmetrics");
+}
@@ -0,0 +1,154 @@
+/* pool_set.cpp - det::pool_set and make_pooled() from detalloc.hpp
+ *
+ * A pool_set<64, 128, 256>: class_of() routes sizes at compile time, each
+ * type is built in the class it routes to and its destruction frees into
+ * that class. A constructor that throws returns its block before the
+ * exception leaves make_pooled(). A second live set of the same type and
+ * a set given too small an arena are not valid() and hand out nothing.
+ */
+#include "det_test.h"
+
+#include <detalloc.hpp>
+
+#include <cstdlib>
+
+namespace {
+
+typedef det::pool_set<64, 128, 256> set_type;
+
+static_assert(set_type::num_classes == 3, "three classes");
+static_assert(set_type::class_of(1) == 0, "1 byte -> 64");
+static_assert(set_type::class_of(64) == 0, "64 bytes -> 64");
+static_assert(set_type::class_of(65) == 1, "65 bytes -> 128");
+static_assert(set_type::class_of(256) == 2, "256 bytes -> 256");
+static_assert(set_type::class_of(257) == set_type::num_classes,
+              "nothing holds 257 bytes");
+static_assert(set_type::size_of(1) == 128, "class 1 is 128 bytes");
+
+int destroyed;
+
+struct small_obj {
+  int id;
+  explicit small_obj(int n) : id(n) {}
+  ~small_obj() { destroyed++; }
+};
+
+struct medium_obj {
+  char body[100];
+  medium_obj() { body[0] = 'm'; }
+  ~medium_obj() { destroyed++; }
+};
+
+struct throwing_obj {
+  char body[200];
+  throwing_obj() { throw 42; }
+};
+
+const det_pool_stats_t &stats_of(const set_type &set, std::size_t cls,
+                                 det_stats_t &st) {
+  det_get_stats(set.pool(cls), &st);
+  return st.pool_stats[0];
+}
+
+} // namespace
+
+int main() {
+  const std::size_t blocks = 4;
+  std::size_t size = set_type::arena_size(blocks);
+  void *mem = std::malloc(size);
+  void *other = std::malloc(size);
+  det_stats_t st;
+
+  CHECK(size != 0 && mem != nullptr && other != nullptr);
+  if (mem == nullptr || other == nullptr) {
+    std::free(mem);
+    std::free(other);
+    return DET_TEST_DONE("pool_set");
+  }
+
+  {
+    set_type set(mem, size, blocks);
+
+    CHECK(set.valid() && set_type::current() == &set);
+
+    /* Each type lands in the class class_of() picked. */
+    {
+      det::pooled_ptr<small_obj, set_type> s =
+          det::make_pooled<small_obj>(set, 7);
+      det::pooled_ptr<medium_obj, set_type> m =
+          det::make_pooled<medium_obj>(set);
+
+      CHECK(s && s->id == 7 && m && m->body[0] == 'm');
+      CHECK(sizeof(s) == sizeof(small_obj *));
+      CHECK(stats_of(set, 0, st).in_use == 1);
+      CHECK(stats_of(set, 1, st).in_use == 1);
+      CHECK(stats_of(set, 2, st).in_use == 0);
+
+      /* Destruction frees into the same class. */
+      s.reset();
+      CHECK(destroyed == 1);
+      CHECK(stats_of(set, 0, st).in_use == 0);
+      CHECK(stats_of(set, 0, st).frees == 1);
+      CHECK(stats_of(set, 1, st).in_use == 1);
+    }
+    CHECK(destroyed == 2);
+    CHECK(stats_of(set, 1, st).in_use == 0);
+    CHECK(stats_of(set, 1, st).frees == 1);
+
+    /* A throwing constructor gives its block back. */
+    bool caught = false;
+    try {
+      det::make_pooled<throwing_obj>(set);
+    } catch (int e) {
+      caught = e == 42;
+    }
+    CHECK(caught);
+    CHECK(stats_of(set, 2, st).allocs == 1);
+    CHECK(stats_of(set, 2, st).in_use == 0);
+
+    /* An exhausted class yields an empty pointer. */
+    {
+      det::pooled_ptr<small_obj, set_type> all[blocks];
+
+      for (std::size_t i = 0; i < blocks; i++) {
+        all[i] = det::make_pooled<small_obj>(set, static_cast<int>(i));
+        CHECK(all[i]);
+      }
+      CHECK(!det::make_pooled<small_obj>(set, 0));
+    }
+    CHECK(stats_of(set, 0, st).in_use == 0);
+
+    /* Only one set of this type may be live. */
+    {
+      set_type second(other, size, blocks);
+
+      CHECK(!second.valid());
+      CHECK(set_type::current() == &set);
+      CHECK(second.allocate<0>() == nullptr);
+      CHECK(!det::make_pooled<small_obj>(second, 1));
+    }
+    CHECK(set.valid());
+  }
+  CHECK(set_type::current() == nullptr);
+
+  /* Too small an arena: not valid, and nothing is live. */
+  {
+    set_type tiny(mem, size / 2, blocks);
+
+    CHECK(!tiny.valid());
+    CHECK(set_type::current() == nullptr);
+    CHECK(tiny.pool(0) == nullptr);
+    CHECK(!det::make_pooled<small_obj>(tiny, 1));
+  }
+
+  /* With the first set gone, a new one takes its place. */
+  {
+    set_type again(other, size, blocks);
+
+    CHECK(again.valid());
+  }
+
+  std::free(mem);
+  std::free(other);
+  return DET_TEST_DONE("pool_set");
+}
@@ -0,0 +1,99 @@
+/* reserved.c - reserved pools: det_commit_ahead(), commit_inline, det_trim()
+ *
+ * 2048 blocks of 4 KiB (four DET_COMMIT_CHUNKs) in PROT_NONE address
+ * space. Nothing is allocatable until det_commit_ahead() commits headroom,
+ * every block handed out must be writable, det_trim() must decommit the
+ * chunks above the bump index, and with commit_inline det_alloc() commits
+ * by itself.
+ */
+#define _DEFAULT_SOURCE
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <string.h>
+#include <sys/mman.h>
+
+#define BLOCK 4096
+#define BLOCKS 2048
+
+static void *blocks[BLOCKS];
+
+static det_allocator_t *make(bool inline_commit, void **mem, size_t *size) {
+  det_config_t cfg = det_default_config();
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.reserved = true;
+  cfg.commit_inline = inline_commit;
+  *size = det_alloc_size(&cfg);
+  *mem = mmap(NULL, *size, PROT_NONE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (*mem == MAP_FAILED) {
+    return NULL;
+  }
+  return det_alloc_init(*mem, *size, &cfg);
+}
+
+/* Allocates until NULL, writing every block; returns the count. */
+static size_t fill(det_allocator_t *det, size_t from) {
+  size_t n = from;
+
+  while (n < BLOCKS && (blocks[n] = det_alloc(det)) != NULL) {
+    memset(blocks[n], 0x5A, BLOCK);
+    n++;
+  }
+  return n;
+}
+
+int main(void) {
+  det_allocator_t *det;
+  size_t size;
+  size_t n;
+  void *mem;
+
+  det = make(false, &mem, &size);
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("reserved");
+  }
+
+  /* Nothing committed yet. */
+  CHECK(det_alloc(det) == NULL);
+
+  /* Headroom of 10 blocks commits at least one whole chunk. */
+  CHECK(det_commit_ahead(det, 10) == DET_OK);
+  n = fill(det, 0);
+  CHECK(n >= 10 && n < BLOCKS);
+  CHECK(n >= DET_COMMIT_CHUNK / BLOCK - 1);
+
+  /* Committing the rest makes the whole pool usable. */
+  CHECK(det_commit_ahead(det, BLOCKS) == DET_OK);
+  n = fill(det, n);
+  CHECK(n == BLOCKS);
+  det_alloc_destroy(det);
+  munmap(mem, size);
+
+  /* Trim: with the bump index low, the chunks above go back to PROT_NONE
+   * and need committing again. */
+  det = make(false, &mem, &size);
+  CHECK(det != NULL && det_commit_ahead(det, BLOCKS) == DET_OK);
+  blocks[0] = det_alloc(det);
+  CHECK(blocks[0] != NULL);
+  CHECK(det_trim(det) >= 2 * (size_t)DET_COMMIT_CHUNK);
+  n = fill(det, 1);
+  CHECK(n < BLOCKS);
+  CHECK(det_commit_ahead(det, BLOCKS) == DET_OK && fill(det, n) == BLOCKS);
+  det_alloc_destroy(det);
+  munmap(mem, size);
+
+  /* commit_inline: det_alloc() commits the chunk it reaches. */
+  det = make(true, &mem, &size);
+  CHECK(det != NULL && fill(det, 0) == BLOCKS);
+  CHECK(det_alloc(det) == NULL);
+  det_alloc_destroy(det);
+  munmap(mem, size);
+
+  return DET_TEST_DONE("reserved");
+}
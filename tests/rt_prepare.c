@@ -0,0 +1,71 @@
+/* rt_prepare.c - det_rt_prepare() on plain, reserved and guarded arenas
+ *
+ * Prefaulting must touch only accessible pages: a partly committed
+ * reserved pool is walked up to its committed end (and reported as
+ * DET_RT_RISK_UNCOMMITTED), a guarded pool short of its guard pages.
+ * Allocation keeps working afterwards, including on thread_safe pools.
+ */
+#define _DEFAULT_SOURCE
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <string.h>
+#include <sys/mman.h>
+
+static void check(det_config_t *cfg, int prot, unsigned want_risk) {
+  det_allocator_t *det;
+  unsigned risks = ~0u;
+  size_t size = det_alloc_size(cfg);
+  void *mem = mmap(NULL, size, prot,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  void *p;
+
+  CHECK(mem != MAP_FAILED);
+  det = mem != MAP_FAILED ? det_alloc_init(mem, size, cfg) : NULL;
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return;
+  }
+  if (cfg->reserved) {
+    CHECK(det_commit_ahead(det, 16) == DET_OK);
+  }
+  CHECK(det_rt_prepare(det, DET_RT_PREFAULT, &risks) == DET_OK);
+  CHECK(risks == want_risk);
+  p = det_alloc(det);
+  CHECK(p != NULL);
+  if (p != NULL) {
+    memset(p, 1, cfg->block_size);
+  }
+  det_free(det, p);
+  det_alloc_destroy(det);
+  munmap(mem, size);
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+
+  CHECK(det_rt_prepare(NULL, DET_RT_PREFAULT, NULL) ==
+        DET_ERR_INVALID_PARAM);
+
+  cfg.block_size = 4096;
+  cfg.num_blocks = 2048;
+  check(&cfg, PROT_READ | PROT_WRITE, 0);
+  cfg.thread_safe = true;
+  check(&cfg, PROT_READ | PROT_WRITE, 0);
+
+  /* Reserved: one chunk committed out of four. */
+  cfg.reserved = true;
+  check(&cfg, PROT_NONE, DET_RT_RISK_UNCOMMITTED);
+  cfg.thread_safe = false;
+  check(&cfg, PROT_NONE, DET_RT_RISK_UNCOMMITTED);
+
+  /* Guarded: PROT_NONE pages between the blocks are skipped. */
+  cfg.reserved = false;
+  cfg.guard_pages = true;
+  cfg.num_blocks = 64;
+  check(&cfg, PROT_READ | PROT_WRITE, 0);
+
+  return DET_TEST_DONE("rt_prepare");
+}
@@ -0,0 +1,115 @@
+/* safelink.c - forged free-list links never hand out a live block
+ *
+ * With every block of a 64-block pool allocated, one block is freed and its
+ * 16-bit link overwritten, as an overflow from its neighbour would. Without
+ * safe_linking the forgery names a chosen live block: the pop that reads it
+ * must drop the list and count one link fault, in plain and signal_safe
+ * mode alike. With safe_linking every possible 16-bit value is tried: the
+ * forged link decodes to noise, and whatever it decodes to, the allocation
+ * that follows may only fail, never return a block that is still live.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK 64
+#define BLOCKS 64
+#define HOLE 40
+#define VICTIM 5
+
+static void *ptrs[BLOCKS];
+
+/* Forges @p link into the freed HOLE; returns the allocation after the one
+ * that takes HOLE back, or (void *)1 if the setup itself failed. */
+static void *attack(void *mem, size_t size, bool signal_safe,
+                    bool safe_linking, uint16_t link, uint64_t *faults) {
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  det_stats_t stats;
+  void *next;
+  size_t i;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.signal_safe = signal_safe;
+  cfg.safe_linking = safe_linking;
+  det = det_alloc_init(mem, size, &cfg);
+  if (det == NULL) {
+    return (void *)1;
+  }
+  for (i = 0; i < BLOCKS; i++) {
+    ptrs[i] = det_alloc(det);
+    if (ptrs[i] == NULL) {
+      return (void *)1;
+    }
+  }
+  det_free(det, ptrs[HOLE]);
+  memcpy(ptrs[HOLE], &link, sizeof(link));
+  if (det_alloc(det) != ptrs[HOLE]) {
+    return (void *)1;
+  }
+  next = det_alloc(det);
+  det_get_stats(det, &stats);
+  *faults = stats.pool_stats[0].link_faults;
+  det_alloc_destroy(det);
+  return next;
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+  size_t size;
+  void *mem;
+  int mode;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.signal_safe = true;
+  size = det_alloc_size(&cfg);
+  cfg.signal_safe = false;
+  if (det_alloc_size(&cfg) > size) {
+    size = det_alloc_size(&cfg);
+  }
+  mem = malloc(size);
+  CHECK(mem != NULL);
+  if (mem == NULL) {
+    return DET_TEST_DONE("safelink");
+  }
+
+  for (mode = 0; mode < 2; mode++) {
+    bool signal_safe = mode != 0;
+    uint64_t faults = 0;
+    unsigned handed = 0;
+    unsigned value;
+
+    /* Unmangled: the link names the victim (index + 1) outright. */
+    CHECK(attack(mem, size, signal_safe, false, VICTIM + 1, &faults) == NULL);
+    CHECK(faults == 1);
+
+    /* Every link that reaches a block in use is rejected the same way. */
+    for (value = 1; value <= BLOCKS; value++) {
+      if (attack(mem, size, signal_safe, false, (uint16_t)value, &faults) !=
+              NULL ||
+          faults != 1) {
+        handed++;
+      }
+    }
+    CHECK(handed == 0);
+
+    /* Mangled: no 16-bit value yields a live block. */
+    handed = 0;
+    for (value = 0; value <= UINT16_MAX; value++) {
+      if (attack(mem, size, signal_safe, true, (uint16_t)value, &faults) !=
+          NULL) {
+        handed++;
+      }
+    }
+    CHECK(handed == 0);
+  }
+
+  free(mem);
+  return DET_TEST_DONE("safelink");
+}
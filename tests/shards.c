@@ -0,0 +1,154 @@
+/* shards.c - sharded pools: probing, probe bound, frees and stats
+ *
+ * One class of 64 blocks split over 4 shards of 16. A single thread always
+ * starts at the same home shard: it fills that first, then moves on to
+ * the shards after it, and with shard_probes = 1 it gives up once home
+ * and the next shard are full, counting the failure at home. A freed
+ * block goes back to the shard it came from, not to the home shard of
+ * the thread freeing it. det_get_stats() reports every shard as a pool.
+ * Shard counts that are not a power of two, and shards combined with
+ * signal_safe, handles or without thread_safe, are refused.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdlib.h>
+
+#define BLOCK 64
+#define BLOCKS 64
+#define SHARDS 4
+#define PER_SHARD (BLOCKS / SHARDS)
+
+static void *ptrs[BLOCKS];
+
+static det_config_t sharded(size_t probes) {
+  det_config_t cfg = det_default_config();
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  cfg.thread_safe = true;
+  cfg.shards = SHARDS;
+  cfg.shard_probes = probes;
+  return cfg;
+}
+
+/* Shard whose in_use differs from @p before, or SHARDS if none does. */
+static size_t changed(const det_stats_t *before, const det_stats_t *after) {
+  size_t i;
+
+  for (i = 0; i < SHARDS; i++) {
+    if (before->pool_stats[i].in_use != after->pool_stats[i].in_use) {
+      return i;
+    }
+  }
+  return SHARDS;
+}
+
+int main(void) {
+  static det_stats_t before;
+  static det_stats_t stats;
+  det_config_t cfg = sharded(0);
+  det_allocator_t *det;
+  size_t home;
+  size_t size;
+  size_t n;
+  size_t i;
+  void *mem;
+
+  size = det_alloc_size(&cfg);
+  mem = size != 0 ? malloc(size) : NULL;
+  CHECK(mem != NULL);
+  if (mem == NULL) {
+    return DET_TEST_DONE("shards");
+  }
+
+  /* All probes: home first, then every other shard in turn. */
+  det = det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det != NULL) {
+    det_get_stats(det, &before);
+    CHECK(before.num_pools == SHARDS);
+    for (i = 0; i < SHARDS; i++) {
+      CHECK(before.pool_stats[i].block_size == BLOCK);
+      CHECK(before.pool_stats[i].num_blocks == PER_SHARD);
+    }
+    ptrs[0] = det_alloc(det);
+    det_get_stats(det, &stats);
+    home = changed(&before, &stats);
+    CHECK(home < SHARDS);
+    for (n = 1; n < BLOCKS; n++) {
+      ptrs[n] = det_alloc(det);
+      CHECK(ptrs[n] != NULL);
+      if (n % PER_SHARD == 0) {
+        det_get_stats(det, &before);
+      } else if (n % PER_SHARD == PER_SHARD - 1) {
+        det_get_stats(det, &stats);
+        CHECK(changed(&before, &stats) == (home + n / PER_SHARD) % SHARDS);
+        CHECK(stats.pool_stats[(home + n / PER_SHARD) % SHARDS].in_use ==
+              PER_SHARD);
+      }
+    }
+    CHECK(det_alloc(det) == NULL);
+    det_get_stats(det, &stats);
+    CHECK(stats.used_memory == BLOCKS * BLOCK);
+    CHECK(stats.pool_stats[home].failures == 1);
+
+    /* A block from the third shard probed goes back there. */
+    det_get_stats(det, &before);
+    det_free(det, ptrs[2 * PER_SHARD + 3]);
+    det_get_stats(det, &stats);
+    CHECK(changed(&before, &stats) == (home + 2) % SHARDS);
+    CHECK(stats.pool_stats[(home + 2) % SHARDS].in_use == PER_SHARD - 1);
+    CHECK(stats.pool_stats[(home + 2) % SHARDS].frees == 1);
+    CHECK(stats.pool_stats[home].frees == 0);
+    CHECK(det_alloc(det) == ptrs[2 * PER_SHARD + 3]);
+    for (n = 0; n < BLOCKS; n++) {
+      det_free(det, ptrs[n]);
+    }
+    det_get_stats(det, &stats);
+    CHECK(stats.used_memory == 0);
+    det_alloc_destroy(det);
+  }
+
+  /* One probe: home and the shard after it, then failure. */
+  cfg = sharded(1);
+  det = det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det != NULL) {
+    for (n = 0; n < BLOCKS && (ptrs[n] = det_alloc(det)) != NULL; n++) {
+    }
+    CHECK(n == 2 * PER_SHARD);
+    det_get_stats(det, &stats);
+    CHECK(stats.pool_stats[home].in_use == PER_SHARD);
+    CHECK(stats.pool_stats[(home + 1) % SHARDS].in_use == PER_SHARD);
+    CHECK(stats.pool_stats[(home + 2) % SHARDS].in_use == 0);
+    CHECK(stats.pool_stats[(home + 3) % SHARDS].in_use == 0);
+    CHECK(stats.pool_stats[home].failures == 1);
+    while (n-- > 0) {
+      det_free(det, ptrs[n]);
+    }
+    det_alloc_destroy(det);
+  }
+
+  /* Configurations sharding does not support. */
+  cfg = sharded(0);
+  cfg.shards = 3;
+  CHECK(det_alloc_size(&cfg) == 0);
+  CHECK(det_alloc_init(mem, size, &cfg) == NULL);
+  cfg = sharded(0);
+  cfg.signal_safe = true;
+  CHECK(det_alloc_size(&cfg) == 0);
+  CHECK(det_alloc_init(mem, size, &cfg) == NULL);
+  cfg = sharded(0);
+  cfg.num_handles = 8;
+  CHECK(det_alloc_size(&cfg) == 0);
+  CHECK(det_alloc_init(mem, size, &cfg) == NULL);
+  cfg = sharded(0);
+  cfg.thread_safe = false;
+  CHECK(det_alloc_size(&cfg) == 0);
+  CHECK(det_alloc_init(mem, size, &cfg) == NULL);
+
+  free(mem);
+  return DET_TEST_DONE("shards");
+}
@@ -0,0 +1,137 @@
+/* shm.c - det_shm_init(), det_stats_publish() and det_shm_read()
+ *
+ * A page reads as DET_ERR_NOT_INITIALIZED until the first publish and is
+ * rejected once its magic, version or layout size does not match. A reader
+ * thread copying the page while another thread publishes in a tight loop,
+ * flipping a pool between empty and full in between, must only ever see
+ * whole snapshots: in_use, allocs - frees and used_memory agree, and the
+ * publish count never goes backwards.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK 64
+#define BLOCKS 32
+#define PUBLISHES 20000
+
+static det_allocator_t *det;
+static det_shm_stats_t *page;
+static int done;
+
+static void *publisher(void *arg) {
+  void *live[BLOCKS];
+  int i;
+  int n;
+
+  (void)arg;
+  for (i = 0; i < PUBLISHES; i++) {
+    for (n = 0; n < BLOCKS; n++) {
+      if (i % 2 == 0) {
+        live[n] = det_alloc(det);
+      } else {
+        det_free(det, live[n]);
+      }
+    }
+    det_stats_publish(det, page);
+  }
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/* One snapshot is whole if its counters describe a single moment. */
+static int whole(const det_shm_stats_t *snap) {
+  const det_pool_stats_t *p = &snap->stats.pool_stats[0];
+
+  return snap->stats.num_pools == 1 &&
+         (p->in_use == 0 || p->in_use == BLOCKS) &&
+         p->allocs - p->frees == p->in_use &&
+         snap->stats.used_memory == p->in_use * BLOCK &&
+         p->allocs == BLOCKS * ((snap->publishes + 1) / 2);
+}
+
+int main(void) {
+  static det_shm_stats_t snap;
+  static det_shm_stats_t bad;
+  det_config_t cfg = det_default_config();
+  unsigned char *raw;
+  pthread_t tid;
+  uint64_t last = 0;
+  unsigned reads = 0;
+  unsigned torn = 0;
+  size_t size;
+  void *mem;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = BLOCKS;
+  size = det_alloc_size(&cfg);
+  mem = malloc(size);
+  raw = malloc(sizeof(det_shm_stats_t) + sizeof(uint64_t));
+  det = mem != NULL ? det_alloc_init(mem, size, &cfg) : NULL;
+  CHECK(det != NULL && raw != NULL);
+  if (det == NULL || raw == NULL) {
+    return DET_TEST_DONE("shm");
+  }
+
+  /* Too small, misaligned or missing memory is refused. */
+  CHECK(det_shm_init(NULL, sizeof(det_shm_stats_t)) == NULL);
+  CHECK(det_shm_init(raw, sizeof(det_shm_stats_t) - 1) == NULL);
+  CHECK(det_shm_init(raw + 4, sizeof(det_shm_stats_t)) == NULL);
+  page = det_shm_init(raw, sizeof(det_shm_stats_t));
+  CHECK(page != NULL);
+  if (page == NULL) {
+    return DET_TEST_DONE("shm");
+  }
+
+  /* Nothing published yet. */
+  CHECK(det_shm_read(page, &snap) == DET_ERR_NOT_INITIALIZED);
+  CHECK(det_stats_publish(det, page) == DET_OK);
+  CHECK(det_shm_read(page, &snap) == DET_OK);
+  CHECK(snap.publishes == 1 && snap.stats.pool_stats[0].in_use == 0);
+  CHECK(det_shm_read(NULL, &snap) == DET_ERR_INVALID_PARAM);
+  CHECK(det_shm_read(page, NULL) == DET_ERR_INVALID_PARAM);
+
+  /* A page from another build or no page at all. */
+  memcpy(&bad, page, sizeof(bad));
+  bad.magic = 0;
+  CHECK(det_shm_read(&bad, &snap) == DET_ERR_INVALID_PARAM);
+  CHECK(det_stats_publish(det, &bad) == DET_ERR_INVALID_PARAM);
+  memcpy(&bad, page, sizeof(bad));
+  bad.version = DET_SHM_VERSION + 1u;
+  CHECK(det_shm_read(&bad, &snap) == DET_ERR_INVALID_PARAM);
+  memcpy(&bad, page, sizeof(bad));
+  bad.layout_size = (uint32_t)sizeof(bad) - 8u;
+  CHECK(det_shm_read(&bad, &snap) == DET_ERR_INVALID_PARAM);
+
+  /* Concurrent publishes: every successful read is a whole snapshot. */
+  page = det_shm_init(raw, sizeof(det_shm_stats_t));
+  CHECK(pthread_create(&tid, NULL, publisher, NULL) == 0);
+  while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+    det_error_t err = det_shm_read(page, &snap);
+
+    if (err == DET_OK) {
+      reads++;
+      torn += !whole(&snap) || snap.publishes < last;
+      last = snap.publishes;
+    } else {
+      CHECK(err == DET_ERR_BUSY || err == DET_ERR_NOT_INITIALIZED);
+    }
+  }
+  pthread_join(tid, NULL);
+  CHECK(torn == 0);
+  CHECK(reads > 0);
+  CHECK(det_shm_read(page, &snap) == DET_OK);
+  CHECK(snap.publishes == PUBLISHES && whole(&snap));
+
+  det_alloc_destroy(det);
+  free(raw);
+  free(mem);
+  return DET_TEST_DONE("shm");
+}
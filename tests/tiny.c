@@ -0,0 +1,110 @@
+/* tiny.c - tiny classes with two and three summary levels
+ *
+ * Tiny blocks (half a pointer or less) have no free list: the lowest hole
+ * is found from the top summary level down. Pools of 5000 and 300000
+ * 2-byte blocks, past the 4096 and 262144 blocks one and two levels
+ * cover, are filled, then scattered blocks are freed: single blocks far
+ * apart, a whole bitmap word, a whole first-level summary word and the
+ * last block. Refilling must hand out exactly the freed blocks, each once
+ * and in ascending order, and then fail, even when the same blocks are
+ * freed a second time. A last round frees their neighbours, the first
+ * block and the one before last.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BLOCK 2
+#define MAX_BLOCKS 300000
+
+static unsigned char *ptrs[MAX_BLOCKS];
+static unsigned char freed[MAX_BLOCKS];
+
+static int picked(size_t i, size_t n, int round) {
+  if (round == 0) {
+    return i % 4099 == 17 || (i >= 640 && i < 704) ||
+           (i >= 8192 && i < 8192 + 4096) || i == n - 1;
+  }
+  return i % 4099 == 18 || i % 4099 == 16 || i == 0 || i == n - 2;
+}
+
+/* Frees the round's blocks, takes them back and checks the order. */
+static void cycle(det_allocator_t *det, size_t n, int round) {
+  size_t expect = 0;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    freed[i] = (unsigned char)picked(i, n, round);
+    if (freed[i]) {
+      det_free(det, ptrs[i]);
+    }
+  }
+  for (;;) {
+    unsigned char *p = det_alloc(det);
+    size_t index;
+
+    while (expect < n && !freed[expect]) {
+      expect++;
+    }
+    if (p == NULL) {
+      break;
+    }
+    index = (size_t)(p - ptrs[0]) / BLOCK;
+    CHECK(p >= ptrs[0] && index < n && index == expect);
+    if (index != expect || index >= n) {
+      return;
+    }
+    freed[index] = 0;
+  }
+  CHECK(expect == n);
+}
+
+int main(void) {
+  static const size_t sizes[] = {5000, MAX_BLOCKS};
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  size_t size;
+  size_t t;
+  void *mem;
+
+  cfg.block_size = BLOCK;
+  cfg.num_blocks = MAX_BLOCKS;
+  size = det_alloc_size(&cfg);
+  mem = malloc(size);
+  CHECK(mem != NULL);
+  if (mem == NULL) {
+    return DET_TEST_DONE("tiny");
+  }
+
+  for (t = 0; t < sizeof(sizes) / sizeof(sizes[0]); t++) {
+    size_t n = sizes[t];
+    size_t i;
+
+    cfg.num_blocks = n;
+    det = det_alloc_init(mem, size, &cfg);
+    CHECK(det != NULL);
+    if (det == NULL) {
+      continue;
+    }
+    for (i = 0; i < n; i++) {
+      ptrs[i] = det_alloc(det);
+      CHECK(ptrs[i] != NULL);
+      if (ptrs[i] == NULL || (i > 0 && ptrs[i] != ptrs[0] + i * BLOCK)) {
+        CHECK(ptrs[i] == ptrs[0] + i * BLOCK);
+        break;
+      }
+    }
+    CHECK(det_alloc(det) == NULL);
+    if (i == n) {
+      cycle(det, n, 0);
+      cycle(det, n, 0);
+      cycle(det, n, 1);
+    }
+    det_alloc_destroy(det);
+  }
+  free(mem);
+  return DET_TEST_DONE("tiny");
+}
@@ -0,0 +1,114 @@
+/* tls.c - det_thread_bind() and the thread-local default allocator
+ *
+ * Two threads bound to two allocators must each allocate from their own
+ * arena through det_alloc_tls()/DET_NEW_TLS() (the first shares its
+ * allocator with one live block of the main thread). An unbound thread
+ * gets NULL and det_free_tls() does nothing; a binding in one thread does
+ * not leak into another.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BLOCKS 16
+
+typedef struct {
+  double x;
+  double y;
+} point_t;
+
+typedef struct {
+  det_allocator_t *det;
+  unsigned char *lo;
+  unsigned char *hi;
+  int got;
+  int bad;
+} arena_t;
+
+static arena_t arenas[2];
+
+static int inside(const arena_t *a, const void *p) {
+  return p != NULL && (const unsigned char *)p >= a->lo &&
+         (const unsigned char *)p < a->hi;
+}
+
+static void *worker(void *arg) {
+  arena_t *a = arg;
+  void *live[BLOCKS];
+  point_t *pt;
+  int i;
+
+  if (det_tls_allocator != NULL || det_alloc_tls(8) != NULL) {
+    a->bad = 1;
+  }
+  det_thread_bind(a->det);
+  while (a->got < BLOCKS && (live[a->got] = det_alloc_tls(32)) != NULL) {
+    a->bad |= !inside(a, live[a->got]);
+    a->got++;
+  }
+  for (i = 0; i < a->got; i++) {
+    det_free_tls(live[i]);
+  }
+  pt = DET_NEW_TLS(point_t);
+  a->bad |= !inside(a, pt);
+  det_free_tls(pt);
+  det_thread_bind(NULL);
+  a->bad |= det_alloc_tls(8) != NULL;
+  return NULL;
+}
+
+int main(void) {
+  det_config_t cfg = det_default_config();
+  pthread_t tid[2];
+  det_stats_t stats;
+  size_t size;
+  void *p;
+  int i;
+
+  cfg.block_size = 64;
+  cfg.num_blocks = BLOCKS;
+  size = det_alloc_size(&cfg);
+  for (i = 0; i < 2; i++) {
+    arenas[i].lo = malloc(size);
+    arenas[i].hi = arenas[i].lo + size;
+    arenas[i].det = det_alloc_init(arenas[i].lo, size, &cfg);
+    CHECK(arenas[i].det != NULL);
+    if (arenas[i].det == NULL) {
+      return DET_TEST_DONE("tls");
+    }
+  }
+
+  /* Unbound: NULL, and a free is ignored. */
+  CHECK(det_alloc_tls(8) == NULL);
+  det_free_tls(arenas[0].lo);
+
+  /* The main thread's binding is invisible to the workers. */
+  CHECK(det_thread_bind(arenas[0].det) == DET_OK);
+  p = det_alloc_tls(8);
+  CHECK(inside(&arenas[0], p));
+  for (i = 0; i < 2; i++) {
+    CHECK(pthread_create(&tid[i], NULL, worker, &arenas[i]) == 0);
+  }
+  for (i = 0; i < 2; i++) {
+    pthread_join(tid[i], NULL);
+    CHECK(!arenas[i].bad);
+  }
+  CHECK(arenas[0].got == BLOCKS - 1 && arenas[1].got == BLOCKS);
+  CHECK(det_tls_allocator == arenas[0].det);
+  det_free_tls(p);
+
+  /* Everything went back where it came from. */
+  for (i = 0; i < 2; i++) {
+    det_get_stats(arenas[i].det, &stats);
+    CHECK(stats.pool_stats[0].in_use == 0);
+    det_alloc_destroy(arenas[i].det);
+    free(arenas[i].lo);
+  }
+  return DET_TEST_DONE("tls");
+}
@@ -0,0 +1,91 @@
+/* wait.c - det_alloc_wait(): one free wakes one waiter
+ *
+ * A thread waits on a full four-block pool while the main thread frees a
+ * single block. The waiter must get it promptly, also with watermarks
+ * configured (they are for monitoring and must not hold a waiter while
+ * the pool has room), on thread_safe and signal_safe pools alike. A wait
+ * with nobody freeing must time out.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BLOCKS 4
+#define TIMEOUT_NS 5000000000u
+
+static det_allocator_t *det;
+static void *got;
+static uint64_t waited;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void *waiter(void *arg) {
+  uint64_t t0 = now_ns();
+
+  (void)arg;
+  got = det_alloc_wait(det, TIMEOUT_NS);
+  waited = now_ns() - t0;
+  return NULL;
+}
+
+static void run(bool signal_safe, unsigned high, unsigned low) {
+  det_config_t cfg = det_default_config();
+  struct timespec pause = {0, 20000000};
+  void *blocks[BLOCKS];
+  pthread_t tid;
+  size_t size;
+  void *mem;
+  int i;
+
+  cfg.block_size = 64;
+  cfg.num_blocks = BLOCKS;
+  cfg.thread_safe = !signal_safe;
+  cfg.signal_safe = signal_safe;
+  cfg.high_watermark = (uint8_t)high;
+  cfg.low_watermark = (uint8_t)low;
+  size = det_alloc_size(&cfg);
+  mem = malloc(size);
+  det = det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return;
+  }
+  for (i = 0; i < BLOCKS; i++) {
+    blocks[i] = det_alloc(det);
+  }
+
+  got = NULL;
+  CHECK(pthread_create(&tid, NULL, waiter, NULL) == 0);
+  nanosleep(&pause, NULL);
+  det_free(det, blocks[0]);
+  pthread_join(tid, NULL);
+  CHECK(got == blocks[0]);
+  CHECK(waited < TIMEOUT_NS / 2);
+
+  /* Full again, nobody frees: NULL after the timeout. */
+  waited = now_ns();
+  CHECK(det_alloc_wait(det, 10000000u) == NULL);
+  CHECK(now_ns() - waited >= 10000000u);
+
+  det_alloc_destroy(det);
+  free(mem);
+}
+
+int main(void) {
+  run(false, 0, 0);
+  run(false, 100, 50);
+  run(true, 0, 0);
+  run(true, 100, 50);
+  return DET_TEST_DONE("wait");
+}
@@ -0,0 +1,113 @@
+/* watermark.c - occupancy watermark edges and det_watermark_poll()
+ *
+ * Two classes of 100 blocks with high = 80% and low = 50%. Only the larger
+ * class is driven across its marks, so every edge must be reported for
+ * pool 1, exactly once, and only when the threshold is actually reached.
+ */
+#include "det_test.h"
+
+#include <detalloc.h>
+
+#include <stdlib.h>
+
+#define BLOCKS 100
+
+typedef struct {
+  unsigned calls;
+  size_t pool;
+  unsigned events;
+} seen_t;
+
+static void on_edge(det_allocator_t *alloc, size_t pool, unsigned events,
+                    void *user) {
+  seen_t *seen = user;
+
+  (void)alloc;
+  seen->calls++;
+  seen->pool = pool;
+  seen->events |= events;
+}
+
+static unsigned poll_edges(det_allocator_t *det, seen_t *seen) {
+  seen->calls = 0;
+  seen->pool = (size_t)-1;
+  seen->events = DET_WM_NONE;
+  return det_watermark_poll(det, on_edge, seen);
+}
+
+int main(void) {
+  det_class_config_t classes[2] = {{64, BLOCKS, DET_LIFETIME_ANY, 0},
+                                   {256, BLOCKS, DET_LIFETIME_ANY, 0}};
+  det_config_t cfg = det_default_config();
+  det_allocator_t *det;
+  void *live[BLOCKS];
+  seen_t seen;
+  size_t size;
+  void *mem;
+  int i;
+
+  cfg.classes = classes;
+  cfg.num_classes = 2;
+  cfg.high_watermark = 80;
+  cfg.low_watermark = 50;
+  size = det_alloc_size(&cfg);
+  mem = malloc(size);
+  det = det_alloc_init(mem, size, &cfg);
+  CHECK(det != NULL);
+  if (det == NULL) {
+    return DET_TEST_DONE("watermark");
+  }
+
+  /* Below the high mark nothing is pending. */
+  for (i = 0; i < 79; i++) {
+    live[i] = det_alloc_sized(det, 256);
+    CHECK(live[i] != NULL);
+  }
+  CHECK(!det_watermark_above(det));
+  CHECK(poll_edges(det, &seen) == DET_WM_NONE && seen.calls == 0);
+
+  /* The 80th block is the rising edge, reported once for pool 1. */
+  live[79] = det_alloc_sized(det, 256);
+  CHECK(det_watermark_above(det));
+  CHECK(poll_edges(det, &seen) == DET_WM_HIGH);
+  CHECK(seen.calls == 1 && seen.pool == 1 && seen.events == DET_WM_HIGH);
+  CHECK(poll_edges(det, &seen) == DET_WM_NONE && seen.calls == 0);
+
+  /* Going further up, or back down to just above the low mark, re-arms
+   * nothing. */
+  live[80] = det_alloc_sized(det, 256);
+  det_free(det, live[80]);
+  for (i = 79; i > 50; i--) {
+    det_free(det, live[i]);
+  }
+  CHECK(det_watermark_above(det));
+  CHECK(poll_edges(det, &seen) == DET_WM_NONE);
+
+  /* Reaching 50 blocks is the falling edge. */
+  det_free(det, live[50]);
+  CHECK(!det_watermark_above(det));
+  CHECK(poll_edges(det, &seen) == DET_WM_LOW);
+  CHECK(seen.calls == 1 && seen.pool == 1 && seen.events == DET_WM_LOW);
+
+  /* Both edges between two polls arrive together; without a callback the
+   * return value still carries them and clears them. */
+  for (i = 50; i < 80; i++) {
+    live[i] = det_alloc_sized(det, 256);
+  }
+  for (i = 79; i >= 50; i--) {
+    det_free(det, live[i]);
+  }
+  CHECK(!det_watermark_above(det));
+  CHECK(det_watermark_poll(det, NULL, NULL) == (DET_WM_HIGH | DET_WM_LOW));
+  CHECK(poll_edges(det, &seen) == DET_WM_NONE);
+
+  /* The other class never crossed anything. */
+  for (i = 0; i < BLOCKS; i++) {
+    live[i] = det_alloc_sized(det, 64);
+  }
+  CHECK(poll_edges(det, &seen) == DET_WM_HIGH && seen.pool == 0);
+
+  det_alloc_destroy(det);
+  free(mem);
+  return DET_TEST_DONE("watermark");
+}
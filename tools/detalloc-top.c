@@ -0,0 +1,189 @@
+/* detalloc-top.c - live monitor for a published detalloc statistics page
+ *
+ * Attaches read-only to a det_shm_stats_t that a process publishes with
+ * det_stats_publish() (a file under /dev/shm, or /proc/<pid>/fd/<n> for a
+ * memfd) and prints per-pool occupancy, rates over the last interval and
+ * allocation tail latencies. The monitored process makes no syscalls for it.
+ *
+ * Usage: detalloc-top [-i interval_ms] [-n iterations] <path>
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <detalloc.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static det_shm_stats_t prev;
+static det_shm_stats_t cur;
+
+static double now_sec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Inclusive upper bound in cycles of the bucket holding quantile @p q of
+ * the interval's samples, 2^(b+1) - 1 like the le bounds of
+ * det_stats_format_openmetrics(); 0 if there were none. */
+static uint64_t quantile(const uint64_t *now, const uint64_t *before,
+                         double q) {
+  uint64_t total = 0;
+  uint64_t seen = 0;
+  uint64_t rank;
+  unsigned b;
+
+  for (b = 0; b < DET_LATENCY_BUCKETS; b++) {
+    total += now[b] - before[b];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  rank = (uint64_t)((double)total * q);
+  if (rank >= total) {
+    rank = total - 1;
+  }
+  for (b = 0; b < DET_LATENCY_BUCKETS; b++) {
+    seen += now[b] - before[b];
+    if (seen > rank) {
+      break;
+    }
+  }
+  return ((uint64_t)1 << (b + 1)) - 1u;
+}
+
+static void show(const char *path, double dt) {
+  const det_stats_t *s = &cur.stats;
+  size_t i;
+
+  printf("\033[H\033[J");
+  printf("detalloc-top  %s  publishes %llu  pools %zu  used %zu/%zu B\n",
+         path, (unsigned long long)cur.publishes, s->num_pools,
+         s->used_memory, s->total_memory);
+  if (s->frame_size != 0) {
+    printf("frame region  %zu/%zu B  peak %zu B  failures %llu\n",
+           s->frame_used, s->frame_size, s->frame_peak,
+           (unsigned long long)s->frame_failures);
+  }
+  printf("\n%4s %8s %17s %8s %9s %9s %7s %8s %8s %8s %9s %2s\n", "pool",
+         "size", "in_use/blocks", "peak", "alloc/s", "free/s", "fail/s",
+         "p50", "p99", "p99.9", "wcet", "wm");
+  for (i = 0; i < s->num_pools && i < DET_MAX_CLASSES; i++) {
+    const det_pool_stats_t *p = &s->pool_stats[i];
+    const det_pool_stats_t *q = &prev.stats.pool_stats[i];
+    char occ[32];
+
+    snprintf(occ, sizeof(occ), "%zu/%zu", p->in_use, p->num_blocks);
+    printf("%4zu %8zu %17s %8zu %9.0f %9.0f %7.0f %8llu %8llu %8llu %9llu "
+           "%2s\n",
+           i, p->block_size, occ, p->peak_in_use,
+           (double)(p->allocs - q->allocs) / dt,
+           (double)(p->frees - q->frees) / dt,
+           (double)(p->failures - q->failures) / dt,
+           (unsigned long long)quantile(p->alloc_latency_hist,
+                                        q->alloc_latency_hist, 0.5),
+           (unsigned long long)quantile(p->alloc_latency_hist,
+                                        q->alloc_latency_hist, 0.99),
+           (unsigned long long)quantile(p->alloc_latency_hist,
+                                        q->alloc_latency_hist, 0.999),
+           (unsigned long long)p->alloc_wcet, p->above_watermark ? "HI" : "");
+  }
+  printf("\nrates over the last %.2f s; latencies are cycle bucket bounds\n",
+         dt);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  const det_shm_stats_t *page;
+  struct timespec interval;
+  struct stat st;
+  long interval_ms = 1000;
+  long iterations = -1;
+  double t_prev;
+  int fd;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+    if (opt == 'i') {
+      interval_ms = atol(optarg);
+    } else if (opt == 'n') {
+      iterations = atol(optarg);
+    } else {
+      optind = argc + 1;
+      break;
+    }
+  }
+  if (optind != argc - 1 || interval_ms <= 0) {
+    fprintf(stderr, "usage: %s [-i interval_ms] [-n iterations] <path>\n",
+            argv[0]);
+    return 2;
+  }
+
+  fd = open(argv[optind], O_RDONLY);
+  if (fd < 0) {
+    perror(argv[optind]);
+    return 1;
+  }
+  /* Touching a mapping past the end of the file raises SIGBUS. */
+  if (fstat(fd, &st) != 0) {
+    perror(argv[optind]);
+    close(fd);
+    return 1;
+  }
+  if (st.st_size < (off_t)sizeof(*page)) {
+    fprintf(stderr, "%s: %lld bytes, too small for a detalloc stats page\n",
+            argv[optind], (long long)st.st_size);
+    close(fd);
+    return 1;
+  }
+  page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  interval.tv_sec = interval_ms / 1000;
+  interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+  if (det_shm_read(page, &prev) == DET_ERR_INVALID_PARAM) {
+    fprintf(stderr, "%s: not a compatible detalloc stats page\n",
+            argv[optind]);
+    return 1;
+  }
+  t_prev = now_sec();
+
+  while (iterations != 0) {
+    det_error_t err;
+    double t;
+
+    nanosleep(&interval, NULL);
+    err = det_shm_read(page, &cur);
+    t = now_sec();
+    if (err == DET_OK && cur.publishes < prev.publishes) {
+      /* The publisher restarted: its counters start over too. */
+      printf("publisher restarted, resetting rates...\n");
+      prev = cur;
+      t_prev = t;
+    } else if (err == DET_OK) {
+      show(argv[optind], t - t_prev);
+      prev = cur;
+      t_prev = t;
+    } else if (err == DET_ERR_NOT_INITIALIZED) {
+      printf("waiting for the first publish...\n");
+    } else if (err != DET_ERR_BUSY) {
+      fprintf(stderr, "%s: page became invalid\n", argv[optind]);
+      return 1;
+    }
+    if (iterations > 0) {
+      iterations--;
+    }
+  }
+  return 0;
+}